@@ -0,0 +1,178 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "AttributeTable.h"
+#include "io.h"
+#include "boost/locale.hpp"
+
+AttributeTable::AttributeTable(OGRFeatureDefn* featureDefn) {
+  _numberrows = 0;
+  int fieldCount = featureDefn->GetFieldCount();
+  for (int i = 0; i < fieldCount; i++) {
+    OGRFieldDefn* fieldDefn = featureDefn->GetFieldDefn(i);
+    std::string name = boost::locale::to_lower(fieldDefn->GetNameRef());
+    _schema.push_back(std::make_pair(name, fieldDefn->GetType()));
+    _fieldindex[name] = i;
+  }
+  _values.resize(fieldCount);
+  _offsets.assign(fieldCount, std::vector<std::size_t>(1, 0));
+}
+
+//-- for the features given from memory (see Map3d::add_polygon): the schema is the names
+//-- and types of attributes, sorted by name
+AttributeTable::AttributeTable(const AttributeMap& attributes) {
+  _numberrows = 0;
+  std::map<std::string, OGRFieldType> sorted;
+  for (auto& a : attributes)
+    sorted[boost::locale::to_lower(a.first)] = a.second.first;
+  for (auto& field : sorted) {
+    _fieldindex[field.first] = int(_schema.size());
+    _schema.push_back(field);
+  }
+  _values.resize(_schema.size());
+  _offsets.assign(_schema.size(), std::vector<std::size_t>(1, 0));
+}
+
+AttributeTable::AttributeTable() {
+  _numberrows = 0;
+}
+
+//-- appends the values of f (which must have the schema of the table), returns its row.
+//-- The value of the field replacefieldi, if any, is replacevalue instead.
+std::size_t AttributeTable::add_row(OGRFeature* f, int replacefieldi, const std::string& replacevalue) {
+  for (int i = 0; i < int(_schema.size()); i++) {
+    if (i == replacefieldi)
+      _values[i].append(replacevalue);
+    else
+      _values[i].append(f->GetFieldAsString(i));
+    _offsets[i].push_back(_values[i].size());
+  }
+  return _numberrows++;
+}
+
+//-- appends the values of the attributes with a field in the schema, the missing ones are empty
+std::size_t AttributeTable::add_row(const AttributeMap& attributes) {
+  std::vector<const std::string*> row(_schema.size(), nullptr);
+  for (auto& a : attributes) {
+    int fieldi = find_field(boost::locale::to_lower(a.first));
+    if (fieldi != -1)
+      row[fieldi] = &(a.second.second);
+  }
+  for (int i = 0; i < int(_schema.size()); i++) {
+    if (row[i] != nullptr)
+      _values[i].append(*row[i]);
+    _offsets[i].push_back(_values[i].size());
+  }
+  return _numberrows++;
+}
+
+std::size_t AttributeTable::get_number_rows() {
+  return _numberrows;
+}
+
+int AttributeTable::get_number_fields() {
+  return int(_schema.size());
+}
+
+std::string AttributeTable::get_field_name(int fieldi) {
+  return _schema[fieldi].first;
+}
+
+OGRFieldType AttributeTable::get_field_type(int fieldi) {
+  return _schema[fieldi].second;
+}
+
+//-- index of the field with this (lower-case) name, -1 if it does not exist
+int AttributeTable::find_field(const std::string& name) {
+  auto it = _fieldindex.find(name);
+  if (it == _fieldindex.end())
+    return -1;
+  return it->second;
+}
+
+std::string AttributeTable::get_value(std::size_t row, int fieldi) {
+  const std::vector<std::size_t>& offsets = _offsets[fieldi];
+  return _values[fieldi].substr(offsets[row], offsets[row + 1] - offsets[row]);
+}
+
+std::size_t AttributeTable::get_memory_usage() {
+  std::size_t bytes = sizeof(AttributeTable);
+  for (auto& field : _schema)
+    bytes += sizeof(field) + field.first.capacity();
+  bytes += (sizeof(std::pair<std::string, int>) + sizeof(void*)) * _fieldindex.size();
+  for (auto& v : _values)
+    bytes += sizeof(v) + v.capacity();
+  for (auto& o : _offsets)
+    bytes += sizeof(o) + sizeof(std::size_t) * o.capacity();
+  return bytes;
+}
+
+void AttributeTable::write(std::ostream& os) {
+  write_binary(os, (unsigned long long)_numberrows);
+  write_binary(os, (unsigned long long)_schema.size());
+  for (int i = 0; i < int(_schema.size()); i++) {
+    write_binary_string(os, _schema[i].first);
+    write_binary(os, (int)_schema[i].second);
+    write_binary_string(os, _values[i]);
+    write_binary(os, (unsigned long long)_offsets[i].size());
+    for (auto& o : _offsets[i])
+      write_binary(os, (unsigned long long)o);
+  }
+}
+
+//-- replaces the content of the table by the one written by write(), false if it cannot be read
+bool AttributeTable::read(std::istream& is) {
+  unsigned long long rowCount, fieldCount;
+  if (read_binary(is, rowCount) == false || read_binary(is, fieldCount) == false)
+    return false;
+  _numberrows = rowCount;
+  _schema.clear();
+  _fieldindex.clear();
+  _values.assign(fieldCount, std::string());
+  _offsets.assign(fieldCount, std::vector<std::size_t>());
+  for (int i = 0; i < int(fieldCount); i++) {
+    std::string name;
+    int type;
+    unsigned long long offsetCount;
+    if (read_binary_string(is, name) == false || read_binary(is, type) == false ||
+        read_binary_string(is, _values[i]) == false || read_binary(is, offsetCount) == false)
+      return false;
+    _schema.push_back(std::make_pair(name, (OGRFieldType)type));
+    _fieldindex[name] = i;
+    _offsets[i].resize(offsetCount);
+    for (auto& o : _offsets[i]) {
+      unsigned long long offset;
+      if (read_binary(is, offset) == false || offset > _values[i].size())
+        return false;
+      o = offset;
+    }
+    if (_offsets[i].size() != rowCount + 1)
+      return false;
+  }
+  return true;
+}
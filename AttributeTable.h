@@ -0,0 +1,62 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef AttributeTable_h
+#define AttributeTable_h
+
+#include "definitions.h"
+
+//-- attributes of all the features of one input layer: the schema (lower-cased
+//-- field names and types) is stored once, the values column by column. Each
+//-- column is one string buffer with the offset of each row in it.
+class AttributeTable {
+public:
+  AttributeTable(OGRFeatureDefn* featureDefn);
+  AttributeTable(const AttributeMap& attributes);
+  AttributeTable();
+
+  std::size_t   add_row(OGRFeature* f, int replacefieldi = -1, const std::string& replacevalue = "");
+  std::size_t   add_row(const AttributeMap& attributes);
+  std::size_t   get_number_rows();
+  int           get_number_fields();
+  std::string   get_field_name(int fieldi);
+  OGRFieldType  get_field_type(int fieldi);
+  int           find_field(const std::string& name);
+  std::string   get_value(std::size_t row, int fieldi);
+  std::size_t   get_memory_usage();
+  void          write(std::ostream& os);
+  bool          read(std::istream& is);
+private:
+  std::vector< std::pair<std::string, OGRFieldType> > _schema;
+  std::unordered_map<std::string, int>                _fieldindex;
+  std::vector<std::string>                            _values; //-- one buffer per field
+  std::vector< std::vector<std::size_t> >             _offsets; //-- per field, start of each row (+ end)
+  std::size_t                                         _numberrows; //-- also without fields
+};
+
+#endif /* AttributeTable_h */
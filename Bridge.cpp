@@ -29,10 +29,8 @@
 #include "Bridge.h"
 #include "io.h"
 
-float Bridge::_heightref = 0.5;
-
-Bridge::Bridge(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref)
-  : Flat(wkt, layername, attributes, pid) {
+Bridge::Bridge(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref)
+  : Flat(p2, layername, attributes, attributerow, pid) {
   _heightref = heightref;
 }
 
@@ -69,7 +67,7 @@ bool Bridge::lift() {
 void Bridge::get_citygml(std::ostream& of) {
   of << "<cityObjectMember>";
   of << "<brg:Bridge gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<brg:lod1MultiSurface>";
   of << "<gml:MultiSurface>";
   for (auto& t : _triangles)
@@ -33,7 +33,7 @@
 
 class Bridge: public Flat {
 public:
-  Bridge(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref);
+  Bridge(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref);
 
   bool          lift();
   bool          add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
@@ -43,7 +43,7 @@ public:
   bool          get_shape(OGRLayer* layer, bool writeAttributes, AttributeMap extraAttributes = AttributeMap());
   TopoClass     get_class();
   bool          is_hard();
-  static float  _heightref;
+  float         _heightref;
 };
 
 #endif /* Bridge_h */
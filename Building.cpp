@@ -30,11 +30,8 @@
 #include "io.h"
 #include <algorithm>    // std::sort
 
-float Building::_heightref_top = 0.9f;
-float Building::_heightref_base = 0.1f;
-
-Building::Building(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref_top, float heightref_base)
-  : Flat(wkt, layername, attributes, pid)
+Building::Building(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref_top, float heightref_base)
+  : Flat(p2, layername, attributes, attributerow, pid)
 {
   _heightref_top = heightref_top;
   _heightref_base = heightref_base;
@@ -50,24 +47,26 @@ std::string Building::get_all_z_values() {
   return ss.str();
 }
 
-int Building::get_height_ground_at_percentile(float percentile) {
-  if (_zvaluesground.empty() == false) {
-    std::nth_element(_zvaluesground.begin(), _zvaluesground.begin() + (_zvaluesground.size() * percentile), _zvaluesground.end());
-    return _zvaluesground[_zvaluesground.size() * percentile];
-  }
-  else {
-    return -9999;
+//-- the values at the percentiles (-9999 if there are none), from a sorted copy: the samples
+//-- are not reordered, several outputs can be written from them at the same time
+static std::vector<int> get_values_at_percentiles(std::vector<int> zvalues, const std::vector<float>& percentiles) {
+  std::vector<int> heights;
+  std::sort(zvalues.begin(), zvalues.end());
+  for (auto& percentile : percentiles) {
+    if (zvalues.empty() == false)
+      heights.push_back(zvalues[zvalues.size() * percentile]);
+    else
+      heights.push_back(-9999);
   }
+  return heights;
 }
 
-int Building::get_height_roof_at_percentile(float percentile) {
-  if (_zvaluesinside.empty() == false) {
-    std::nth_element(_zvaluesinside.begin(), _zvaluesinside.begin() + (_zvaluesinside.size() * percentile), _zvaluesinside.end());
-    return _zvaluesinside[_zvaluesinside.size() * percentile];
-  }
-  else {
-    return -9999;
-  }
+std::vector<int> Building::get_heights_ground_at_percentiles(const std::vector<float>& percentiles) {
+  return get_values_at_percentiles(_zvaluesground, percentiles);
+}
+
+std::vector<int> Building::get_heights_roof_at_percentiles(const std::vector<float>& percentiles) {
+  return get_values_at_percentiles(_zvaluesinside, percentiles);
 }
 
 bool Building::lift() {
@@ -105,6 +104,24 @@ bool Building::add_elevation_point(Point2 &p, double z, float radius, LAS14Class
   return true;
 }
 
+void Building::release_lifting_data() {
+  TopoFeature::release_lifting_data();
+  std::vector<int>().swap(_zvaluesground);
+}
+
+std::size_t Building::get_memory_usage() {
+  return Flat::get_memory_usage() + sizeof(int) * _zvaluesground.capacity();
+}
+
+void Building::write_samples(std::ostream& os) {
+  Flat::write_samples(os);
+  write_binary_vector(os, _zvaluesground);
+}
+
+bool Building::read_samples(std::istream& is) {
+  return Flat::read_samples(is) && read_binary_vector(is, _zvaluesground);
+}
+
 int Building::get_height_base() {
   return _height_base;
 }
@@ -173,7 +190,7 @@ void Building::get_citygml(std::ostream& of) {
   float hbase = z_to_float(this->get_height_base());
   of << "<cityObjectMember>";
   of << "<bldg:Building gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<gen:measureAttribute name=\"min height surface\">";
   of << "<gen:value uom=\"#m\">" << hbase << "</gen:value>";
   of << "</gen:measureAttribute>";
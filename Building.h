@@ -33,7 +33,7 @@
 
 class Building: public Flat {
 public:
-  Building(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref_top, float heightref_base);
+  Building(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref_top, float heightref_base);
   bool          lift();
   bool          add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   void          get_obj(std::unordered_map< std::string, unsigned long > &dPts, int lod, std::string mtl, std::string &fs);
@@ -47,12 +47,16 @@ public:
   TopoClass     get_class();
   bool          is_hard();
   int           get_height_base();
-  int           get_height_ground_at_percentile(float percentile);
-  int           get_height_roof_at_percentile(float percentile);
+  std::vector<int> get_heights_ground_at_percentiles(const std::vector<float>& percentiles);
+  std::vector<int> get_heights_roof_at_percentiles(const std::vector<float>& percentiles);
+  void          release_lifting_data();
+  std::size_t   get_memory_usage();
+  void          write_samples(std::ostream& os);
+  bool          read_samples(std::istream& is);
 private:
   std::vector<int>    _zvaluesground;
-  static float        _heightref_top;
-  static float        _heightref_base;
+  float               _heightref_top;
+  float               _heightref_base;
   int                 _height_base;
 };
 
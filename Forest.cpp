@@ -30,10 +30,8 @@
 #include "Forest.h"
 #include "io.h"
 
-bool Forest::_use_ground_points_only = false;
-
-Forest::Forest(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, float innerbuffer, bool ground_points_only)
-  : TIN(wkt, layername, attributes, pid, simplification, innerbuffer)
+Forest::Forest(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, int simplification, float innerbuffer, bool ground_points_only, double simplification_tinsimp, unsigned long max_points)
+  : TIN(p2, layername, attributes, attributerow, pid, simplification, innerbuffer, simplification_tinsimp, max_points)
 {
   _use_ground_points_only = ground_points_only;
 }
@@ -66,7 +64,7 @@ bool Forest::lift() {
 void Forest::get_citygml(std::ostream& of) {
   of << "<cityObjectMember>";
   of << "<veg:PlantCover gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<veg:lod1MultiSurface>";
   of << "<gml:MultiSurface>";
   for (auto& t : _triangles)
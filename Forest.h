@@ -33,7 +33,7 @@
 
 class Forest: public TIN {
 public:
-  Forest(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, float innerbuffer, bool only_ground_points);
+  Forest(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, int simplification, float innerbuffer, bool only_ground_points, double simplification_tinsimp = 0, unsigned long max_points = 0);
   bool          lift();
   bool          add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   void          get_citygml(std::ostream& of);
@@ -43,7 +43,7 @@ public:
   TopoClass     get_class();
   bool          is_hard();
 private:
-  static bool   _use_ground_points_only;
+  bool          _use_ground_points_only;
 };
 
 #endif /* Forest_h */
@@ -28,24 +28,41 @@
 
 #include "Map3d.h"
 #include "io.h"
+#include "threadpool.h"
 #include "boost/locale.hpp"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cctype>
+#include <cstdint>
+
+//-- the lifting class of each TopoClass, to create a feature again (snapshot, daemon)
+static const char* liftingclasses[7] = { "Building", "Water", "Bridge/Overpass", "Road", "Terrain", "Forest", "Separation" };
 
 Map3d::Map3d() {
   OGRRegisterAll();
   _building_include_floor = false;
   _building_lod = 1;
   _use_vertical_walls = false;
+  std::fill(_featurebytes, _featurebytes + 7, 0);
   _building_heightref_roof = 0.9f;
   _building_heightref_floor = 0.1f;
   _building_triangulate = true;
   _terrain_simplification = 0;
   _forest_simplification = 0;
+  _terrain_simplification_tinsimp = 0.0;
+  _forest_simplification_tinsimp = 0.0;
+  _terrain_max_points = 0;
+  _forest_max_points = 0;
   _terrain_innerbuffer = 0.0;
   _forest_innerbuffer = 0.0;
   _forest_ground_points_only = false;
   _radius_vertex_elevation = 1.0;
   _building_radius_vertex_elevation = 3.0;
   _threshold_jump_edges = 50;
+  _number_of_threads = 0;
+  _requestedExtent = Box2(Point2(0, 0), Point2(0, 0));
+  _tile = Box2(Point2(0, 0), Point2(0, 0));
+  _featurecounter = 0;
   bg::set<bg::min_corner, 0>(_bbox, 999999);
   bg::set<bg::min_corner, 1>(_bbox, 999999);
   bg::set<bg::max_corner, 0>(_bbox, -999999);
@@ -53,8 +70,349 @@ Map3d::Map3d() {
 }
 
 Map3d::~Map3d() {
-  // TODO : destructor Map3d
-  _lsFeatures.clear();
+  clear_features();
+}
+
+//-- destroys all the features and gives the memory of the arena back
+void Map3d::clear_features() {
+  _rtree.clear();
+  NodeColumn().swap(_nc);
+  for (auto& f : _lsFeatures)
+    f->~TopoFeature();
+  std::vector<TopoFeature*>().swap(_lsFeatures);
+  _arena.release();
+  for (auto& t : _attributetables)
+    delete t;
+  _attributetables.clear();
+  _memorytables.clear();
+  std::fill(_featurebytes, _featurebytes + 7, 0);
+}
+
+//-- a snapshot is valid for the same input files and the same settings used while reading them;
+//-- the keys are empty if an input is not a file (then no snapshot can be used). The polygons and
+//-- the points have separate keys: in incremental mode only the points must be unchanged.
+std::string Map3d::get_snapshot_polygons_key(std::vector<PolygonFile> &polygonFiles) {
+  boost::system::error_code ec;
+  std::ostringstream key;
+  for (auto& file : polygonFiles) {
+    if (boost::filesystem::is_regular_file(file.filename, ec) == false)
+      return std::string();
+    key << file.filename << "|" << boost::filesystem::file_size(file.filename) << "|" << boost::filesystem::last_write_time(file.filename);
+    key << "|" << file.idfield << "|" << file.heightfield << "|" << file.handle_multiple_heights;
+    for (auto& layer : file.layers)
+      key << "|" << layer.first << "|" << layer.second;
+    key << "\n";
+  }
+  return key.str();
+}
+
+std::string Map3d::get_snapshot_points_key(std::vector<PointFile> &pointFiles) {
+  boost::system::error_code ec;
+  std::ostringstream key;
+  key << std::setprecision(17);
+  for (auto& file : pointFiles) {
+    if (boost::filesystem::is_regular_file(file.filename, ec) == false)
+      return std::string();
+    key << file.filename << "|" << boost::filesystem::file_size(file.filename) << "|" << boost::filesystem::last_write_time(file.filename);
+    key << "|" << file.thinning;
+    for (auto& c : file.lasomits)
+      key << "|" << c;
+    key << "\n";
+  }
+  key << bg::get<bg::min_corner, 0>(_requestedExtent) << "|" << bg::get<bg::min_corner, 1>(_requestedExtent) << "|";
+  key << bg::get<bg::max_corner, 0>(_requestedExtent) << "|" << bg::get<bg::max_corner, 1>(_requestedExtent) << "\n";
+  key << _radius_vertex_elevation << "|" << _building_radius_vertex_elevation << "|";
+  key << _terrain_simplification << "|" << _terrain_innerbuffer << "|" << _terrain_max_points << "|";
+  key << _forest_simplification << "|" << _forest_innerbuffer << "|" << _forest_max_points << "|" << _forest_ground_points_only;
+  return key.str();
+}
+
+//-- the features with the elevation samples collected from the points, written after reading the
+//-- points so that a later run can skip reading the polygons and the points. The lifting
+//-- settings are not in the snapshot: the features are created again with those of the run.
+bool Map3d::write_snapshot(std::string filename, std::string polygonskey, std::string pointskey) {
+  std::string tmpfilename = filename + ".tmp";
+  std::ofstream ofs(tmpfilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (ofs.is_open() == false)
+    return false;
+  write_binary_string(ofs, "3DFSNAP2");
+  write_binary_string(ofs, polygonskey);
+  write_binary_string(ofs, pointskey);
+  std::unordered_map<AttributeTable*, int> tableindex;
+  write_binary(ofs, (unsigned long long)_attributetables.size());
+  for (int i = 0; i < int(_attributetables.size()); i++) {
+    tableindex[_attributetables[i]] = i;
+    _attributetables[i]->write(ofs);
+  }
+  write_binary(ofs, (unsigned long long)_lsFeatures.size());
+  for (auto& f : _lsFeatures) {
+    Polygon2* p2 = f->get_Polygon2();
+    write_binary_string(ofs, liftingclasses[f->get_class()]);
+    write_binary(ofs, tableindex[f->get_attribute_table()]);
+    write_binary(ofs, (unsigned long long)f->get_attribute_row());
+    write_binary_string(ofs, f->get_id());
+    write_binary_string(ofs, f->get_layername());
+    write_binary(ofs, f->get_top_level());
+    write_binary(ofs, (unsigned long long)(p2->inners().size() + 1));
+    for (int ri = 0; ri <= int(p2->inners().size()); ri++) {
+      Ring2& ring = (ri == 0) ? p2->outer() : p2->inners()[ri - 1];
+      write_binary(ofs, (unsigned long long)ring.size());
+      for (auto& p : ring) {
+        write_binary(ofs, p.x());
+        write_binary(ofs, p.y());
+      }
+    }
+    f->write_samples(ofs);
+  }
+  ofs.close();
+  boost::system::error_code ec;
+  if (ofs.fail() == true) {
+    boost::filesystem::remove(tmpfilename, ec);
+    return false;
+  }
+  boost::filesystem::rename(tmpfilename, filename, ec);
+  return !ec;
+}
+
+//-- the snapshot is memory-mapped and the features are created from it; false (and the map
+//-- left empty) if there is no snapshot or if it was written for other inputs or settings.
+//-- With an empty polygonskey, the snapshot is read whatever the polygons it was made with.
+bool Map3d::read_snapshot(std::string filename, std::string polygonskey, std::string pointskey) {
+  boost::system::error_code ec;
+  if (boost::filesystem::is_regular_file(filename, ec) == false || boost::filesystem::file_size(filename, ec) == 0)
+    return false;
+  boost::interprocess::file_mapping mapping;
+  boost::interprocess::mapped_region region;
+  try {
+    boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only).swap(mapping);
+    boost::interprocess::mapped_region(mapping, boost::interprocess::read_only).swap(region);
+  }
+  catch (boost::interprocess::interprocess_exception& e) {
+    std::cerr << "Warning: cannot map snapshot " << filename << ": " << e.what() << std::endl;
+    return false;
+  }
+  MemoryStreamBuf buffer(static_cast<const char*>(region.get_address()), region.get_size());
+  std::istream is(&buffer);
+  std::string magic, snapshotpolygonskey, snapshotpointskey;
+  if (read_binary_string(is, magic) == false || magic != "3DFSNAP2" ||
+      read_binary_string(is, snapshotpolygonskey) == false || (polygonskey.empty() == false && snapshotpolygonskey != polygonskey) ||
+      read_binary_string(is, snapshotpointskey) == false || snapshotpointskey != pointskey)
+    return false;
+  bool wentgood = true;
+  unsigned long long numberOfTables, numberOfFeatures;
+  if (read_binary(is, numberOfTables) == false || numberOfTables > (1ULL << 20))
+    return false;
+  for (unsigned long long i = 0; i < numberOfTables && wentgood; i++) {
+    AttributeTable* t = new AttributeTable();
+    _attributetables.push_back(t);
+    wentgood = t->read(is);
+  }
+  if (wentgood == true)
+    wentgood = read_binary(is, numberOfFeatures);
+  for (unsigned long long fi = 0; wentgood == true && fi < numberOfFeatures; fi++) {
+    std::string lifting, id, layername;
+    int table;
+    unsigned long long row, numberOfRings;
+    bool toplevel;
+    if (read_binary_string(is, lifting) == false || read_binary(is, table) == false || table < 0 || table >= int(_attributetables.size()) ||
+        read_binary(is, row) == false || row >= _attributetables[table]->get_number_rows() ||
+        read_binary_string(is, id) == false || read_binary_string(is, layername) == false ||
+        read_binary(is, toplevel) == false || read_binary(is, numberOfRings) == false || numberOfRings == 0 || numberOfRings > (1ULL << 20)) {
+      wentgood = false;
+      break;
+    }
+    Polygon2* p2 = new Polygon2();
+    p2->inners().resize(numberOfRings - 1);
+    for (unsigned long long ri = 0; ri < numberOfRings && wentgood; ri++) {
+      Ring2& ring = (ri == 0) ? p2->outer() : p2->inners()[ri - 1];
+      unsigned long long numberOfPoints;
+      if (read_binary(is, numberOfPoints) == false || numberOfPoints > (1ULL << 32)) {
+        wentgood = false;
+        break;
+      }
+      ring.reserve(numberOfPoints);
+      for (unsigned long long pi = 0; pi < numberOfPoints && wentgood; pi++) {
+        double x, y;
+        wentgood = read_binary(is, x) && read_binary(is, y);
+        ring.push_back(Point2(x, y));
+      }
+    }
+    if (wentgood == false) {
+      delete p2;
+      break;
+    }
+    TopoFeature* p3 = create_topofeature(p2, id, layername, _attributetables[table], row, lifting);
+    if (p3 == nullptr) {
+      wentgood = false;
+      break;
+    }
+    _lsFeatures.push_back(p3);
+    p3->set_top_level(toplevel);
+    wentgood = p3->read_samples(is);
+  }
+  if (wentgood == false) {
+    std::cerr << "Warning: snapshot " << filename << " is corrupted, not used.\n";
+    clear_features();
+    return false;
+  }
+  return true;
+}
+
+//-- the samples are stored per vertex: a polygon is unchanged only if its vertices are the same, in the same order
+static bool same_vertices(Polygon2& a, Polygon2& b) {
+  if (a.inners().size() != b.inners().size())
+    return false;
+  for (int ri = 0; ri <= int(a.inners().size()); ri++) {
+    Ring2& ra = (ri == 0) ? a.outer() : a.inners()[ri - 1];
+    Ring2& rb = (ri == 0) ? b.outer() : b.inners()[ri - 1];
+    if (ra.size() != rb.size())
+      return false;
+    for (std::size_t i = 0; i < ra.size(); i++) {
+      if (ra[i].x() != rb[i].x() || ra[i].y() != rb[i].y())
+        return false;
+    }
+  }
+  return true;
+}
+
+//-- reads the polygons and takes the elevation samples of the features that did not change
+//-- (same layer, id, class and geometry) from the snapshot of the previous run; the other ones
+//-- (added or changed) are returned in dirty, only they need the points. The samples of a
+//-- feature do not depend on its neighbours, so the changes do not spread at this stage; the
+//-- neighbours are updated by the lifting and stitching, which are run for all the features.
+bool Map3d::add_polygons_files_incremental(std::vector<PolygonFile> &files, std::string snapshot, std::string pointskey, std::vector<TopoFeature*>& dirty) {
+  if (read_snapshot(snapshot, std::string(), pointskey) == false)
+    return false;
+  std::vector<TopoFeature*> previous;
+  std::vector<AttributeTable*> previoustables;
+  previous.swap(_lsFeatures);
+  previoustables.swap(_attributetables);
+  bool wentgood = add_polygons_files(files);
+  if (wentgood == true) {
+    std::unordered_map<std::string, TopoFeature*> previousbyid;
+    for (auto& f : previous)
+      previousbyid[f->get_layername() + "|" + f->get_id()] = f;
+    std::size_t unchanged = 0;
+    for (auto& f : _lsFeatures) {
+      auto it = previousbyid.find(f->get_layername() + "|" + f->get_id());
+      if (it != previousbyid.end() && it->second->get_class() == f->get_class() &&
+          same_vertices(*(it->second->get_Polygon2()), *(f->get_Polygon2())) == true) {
+        std::stringstream samples;
+        it->second->write_samples(samples);
+        if (f->read_samples(samples) == true) {
+          previousbyid.erase(it);
+          unchanged++;
+          continue;
+        }
+      }
+      dirty.push_back(f);
+    }
+    std::clog << "Incremental: " << boost::locale::as::number << unchanged << " features unchanged, "
+      << dirty.size() << " added or changed, " << previousbyid.size() << " removed or changed\n";
+  }
+  for (auto& f : previous)
+    f->~TopoFeature(); //-- its memory stays in the arena until clear_features()
+  for (auto& t : previoustables)
+    delete t;
+  if (wentgood == false)
+    clear_features();
+  return wentgood;
+}
+
+//-- copies the features of source (which read all the polygons and points once, see --daemon)
+//-- that intersect the requested extent, with their elevation samples, so that they can be
+//-- lifted without changing source. The attribute tables stay owned by source.
+bool Map3d::add_features_from(Map3d& source) {
+  std::vector<PairIndexed> found;
+  source._rtree.query(bgi::intersects(_requestedExtent), std::back_inserter(found));
+  for (auto& v : found) {
+    TopoFeature* f = v.second;
+    TopoFeature* p3 = create_topofeature(new Polygon2(*(f->get_Polygon2())), f->get_id(), f->get_layername(), f->get_attribute_table(), f->get_attribute_row(), liftingclasses[f->get_class()]);
+    if (p3 == nullptr)
+      return false;
+    _lsFeatures.push_back(p3);
+    p3->set_top_level(f->get_top_level());
+    std::stringstream samples;
+    f->write_samples(samples);
+    if (p3->read_samples(samples) == false)
+      return false;
+  }
+  return true;
+}
+
+//-- true if the centroid of the feature is in the tile (half-open), or if there is no tile
+bool Map3d::is_in_tile(TopoFeature* f) {
+  if (boost::geometry::area(_tile) <= 0)
+    return true;
+  Point2 c;
+  bg::centroid(*(f->get_Polygon2()), c);
+  return (c.x() >= bg::get<bg::min_corner, 0>(_tile) && c.x() < bg::get<bg::max_corner, 0>(_tile) &&
+          c.y() >= bg::get<bg::min_corner, 1>(_tile) && c.y() < bg::get<bg::max_corner, 1>(_tile));
+}
+
+//-- keeps only the features whose centroid is in the tile (half-open, so that a feature
+//-- is in one tile only); the others were only read to lift and stitch those in the tile
+void Map3d::remove_features_outside_tile() {
+  if (boost::geometry::area(_tile) <= 0)
+    return;
+  std::vector<TopoFeature*> kept;
+  for (auto& f : _lsFeatures) {
+    if (is_in_tile(f) == true)
+      kept.push_back(f);
+    else
+      f->~TopoFeature(); //-- its memory stays in the arena until clear_features()
+  }
+  _lsFeatures.swap(kept);
+}
+
+//-- a feature of the tile gets the same heights as without tiles only if the features it is
+//-- stitched with are read too, which holds when it is inside the tile and its halo (those read
+//-- are complete: all the points in their footprint are assigned to them). Warns about the
+//-- features of the tile that are not, with the halo they need.
+bool Map3d::check_tile_halo() {
+  if (boost::geometry::area(_tile) <= 0)
+    return true;
+  unsigned long count = 0;
+  double needed = 0.0;
+  for (auto& f : _lsFeatures) {
+    if (is_in_tile(f) == false)
+      continue;
+    Box2 b;
+    bg::envelope(*(f->get_Polygon2()), b);
+    if (bg::covered_by(b, _requestedExtent) == true)
+      continue;
+    count++;
+    needed = std::max(needed, bg::get<bg::min_corner, 0>(_tile) - bg::get<bg::min_corner, 0>(b));
+    needed = std::max(needed, bg::get<bg::min_corner, 1>(_tile) - bg::get<bg::min_corner, 1>(b));
+    needed = std::max(needed, bg::get<bg::max_corner, 0>(b) - bg::get<bg::max_corner, 0>(_tile));
+    needed = std::max(needed, bg::get<bg::max_corner, 1>(b) - bg::get<bg::max_corner, 1>(_tile));
+  }
+  if (count > 0)
+    std::clog << "Warning: " << count << " features of the tile extend beyond its halo, their heights can differ from those without tiles; "
+              << "'tile_halo' should be at least " << needed << "m.\n";
+  return (count == 0);
+}
+
+void Map3d::print_memory_usage() {
+  const char* classnames[7] = { "Building", "Water", "Bridge", "Road", "Terrain", "Forest", "Separation" };
+  unsigned long count[7] = { 0 };
+  std::size_t heapbytes[7] = { 0 };
+  for (auto& f : _lsFeatures) {
+    count[f->get_class()]++;
+    heapbytes[f->get_class()] += f->get_memory_usage();
+  }
+  std::clog << "Memory used by the features:\n";
+  for (int i = 0; i < 7; i++) {
+    if (count[i] == 0)
+      continue;
+    std::clog << "\t" << classnames[i] << ": " << count[i] << " features, "
+      << (_featurebytes[i] + heapbytes[i]) / 1024 << " kB (" << _featurebytes[i] / 1024 << " kB in arena)\n";
+  }
+  std::size_t attributebytes = 0;
+  for (auto& t : _attributetables)
+    attributebytes += t->get_memory_usage();
+  std::clog << "\tattributes: " << attributebytes / 1024 << " kB\n";
+  std::clog << "\tarena: " << _arena.get_bytes_used() / 1024 << " kB used, " << _arena.get_bytes_reserved() / 1024 << " kB reserved\n";
 }
 
 void Map3d::set_building_heightref_roof(float h) {
@@ -101,6 +459,22 @@ void Map3d::set_forest_simplification(int simplification) {
   _forest_simplification = simplification;
 }
 
+void Map3d::set_terrain_simplification_tinsimp(double threshold) {
+  _terrain_simplification_tinsimp = threshold;
+}
+
+void Map3d::set_forest_simplification_tinsimp(double threshold) {
+  _forest_simplification_tinsimp = threshold;
+}
+
+void Map3d::set_terrain_max_points(unsigned long max_points) {
+  _terrain_max_points = max_points;
+}
+
+void Map3d::set_forest_max_points(unsigned long max_points) {
+  _forest_max_points = max_points;
+}
+
 void Map3d::set_terrain_innerbuffer(float innerbuffer) {
   _terrain_innerbuffer = innerbuffer;
 }
@@ -133,6 +507,22 @@ void Map3d::set_requested_extent(double xmin, double ymin, double xmax, double y
   _requestedExtent = Box2(Point2(xmin, ymin), Point2(xmax, ymax));
 }
 
+//-- the polygons are read in the tile enlarged by the halo, so that the features in the tile are
+//-- lifted and stitched with all their neighbours; the halo is at least the radius used for the points
+void Map3d::set_tile(double xmin, double ymin, double xmax, double ymax, double halo) {
+  halo = std::max(halo, (double)std::max(_radius_vertex_elevation, _building_radius_vertex_elevation));
+  _tile = Box2(Point2(xmin, ymin), Point2(xmax, ymax));
+  _requestedExtent = Box2(Point2(xmin - halo, ymin - halo), Point2(xmax + halo, ymax + halo));
+}
+
+void Map3d::set_number_of_threads(int threads) {
+  _number_of_threads = threads;
+}
+
+void Map3d::set_validate_cdt(bool validate) {
+  set_cdt_validation(validate);
+}
+
 Box2 Map3d::get_bbox() {
   return _bbox;
 }
@@ -245,10 +635,12 @@ void Map3d::get_csv_buildings(std::ostream& of) {
   }
 }
 
+//-- written from the samples, before lifting (which releases them): the features of the halo
+//-- of a tile are still there and are skipped
 void Map3d::get_csv_buildings_all_elevation_points(std::ostream &outputfile) {
   outputfile << "id,allzvalues" << std::endl;
   for (auto& p : _lsFeatures) {
-    if (p->get_class() == BUILDING) {
+    if (p->get_class() == BUILDING && is_in_tile(p) == true) {
       Building* b = dynamic_cast<Building*>(p);
       outputfile << b->get_id() << ",";
       outputfile << b->get_all_z_values();
@@ -257,6 +649,7 @@ void Map3d::get_csv_buildings_all_elevation_points(std::ostream &outputfile) {
   }
 }
 
+//-- written from the samples, like get_csv_buildings_all_elevation_points()
 void Map3d::get_csv_buildings_multiple_heights(std::ostream &outputfile) {
   //-- ground heights
   std::vector<float> gpercentiles = {0.0f, 0.1f, 0.2f, 0.3f, 0.4f, 0.5f};
@@ -269,17 +662,13 @@ void Map3d::get_csv_buildings_multiple_heights(std::ostream &outputfile) {
     outputfile << "roof-" << each << ",";
   outputfile << std::endl;
   for (auto& p : _lsFeatures) {
-    if (p->get_class() == BUILDING) {
+    if (p->get_class() == BUILDING && is_in_tile(p) == true) {
       Building* b = dynamic_cast<Building*>(p);
       outputfile << b->get_id() << ",";
-      for (auto& each : gpercentiles) {
-        int h = b->get_height_ground_at_percentile(each);
+      for (auto& h : b->get_heights_ground_at_percentiles(gpercentiles))
         outputfile << float(h)/100 << ",";
-      }
-      for (auto& each : rpercentiles) {
-        int h = b->get_height_roof_at_percentile(each);
+      for (auto& h : b->get_heights_roof_at_percentiles(rpercentiles))
         outputfile << float(h)/100 << ",";
-      }
       outputfile << std::endl;
     }
   }
@@ -361,10 +750,10 @@ bool Map3d::get_pdok_output(std::string filename) {
     std::string layername = f->get_layername();
     if (layers.find(layername) == layers.end()) {
       std::string tmpFilename = filename;
-      AttributeMap attributes = f->get_attributes();
       //Add additional attribute to list for layer creation
-      attributes["xml"] = std::make_pair(OFTString, "");
-      OGRLayer *layer = create_gdal_layer(driver, tmpFilename, layername, attributes, f->get_class() == BUILDING);
+      AttributeMap extraAttributes;
+      extraAttributes["xml"] = std::make_pair(OFTString, "");
+      OGRLayer *layer = create_gdal_layer(driver, tmpFilename, layername, f->get_attribute_table(), f->get_class() == BUILDING, extraAttributes);
       if (layer == NULL) {
         std::cerr << "ERROR: Cannot open database '" + filename + "' for writing" << std::endl;
         for (auto& layer : layers) {
@@ -404,7 +793,7 @@ bool Map3d::get_gdal_output(std::string filename, std::string drivername, bool m
   GDALDriver *driver = GetGDALDriverManager()->GetDriverByName(drivername.c_str());
 
   if (!multi) {
-    OGRLayer *layer = create_gdal_layer(driver, filename, "my3dmap", AttributeMap(), true);
+    OGRLayer *layer = create_gdal_layer(driver, filename, "my3dmap", NULL, true);
     if (layer == NULL) {
       std::cerr << "ERROR: Cannot open file '" + filename + "' for writing" << std::endl;
       GDALClose(layer);
@@ -427,7 +816,7 @@ bool Map3d::get_gdal_output(std::string filename, std::string drivername, bool m
         if (drivername == "ESRI Shapefile") {
           tmpFilename = filename + layername;
         }
-        OGRLayer *layer = create_gdal_layer(driver, tmpFilename, layername, f->get_attributes(), f->get_class() == BUILDING);
+        OGRLayer *layer = create_gdal_layer(driver, tmpFilename, layername, f->get_attribute_table(), f->get_class() == BUILDING);
         if (layer == NULL) {
           std::cerr << "ERROR: Cannot open file '" + filename + "' for writing" << std::endl;
           for (auto& layer : layers) {
@@ -450,7 +839,7 @@ bool Map3d::get_gdal_output(std::string filename, std::string drivername, bool m
 }
 
 #if GDAL_VERSION_MAJOR >= 2
-OGRLayer* Map3d::create_gdal_layer(GDALDriver *driver, std::string filename, std::string layername, AttributeMap attributes, bool addHeightAttributes) {
+OGRLayer* Map3d::create_gdal_layer(GDALDriver *driver, std::string filename, std::string layername, AttributeTable* attributes, bool addHeightAttributes, AttributeMap extraAttributes) {
   GDALDataset *dataSource = driver->Create(filename.c_str(), 0, 0, 0, GDT_Unknown, NULL);
 
   if (dataSource == NULL) {
@@ -485,7 +874,16 @@ OGRLayer* Map3d::create_gdal_layer(GDALDriver *driver, std::string filename, std
         return NULL;
       }
     }
-    for (auto attr : attributes) {
+    if (attributes != NULL) {
+      for (int i = 0; i < attributes->get_number_fields(); i++) {
+        OGRFieldDefn oField(attributes->get_field_name(i).c_str(), attributes->get_field_type(i));
+        if (layer->CreateField(&oField) != OGRERR_NONE) {
+          std::cerr << "Creating " + attributes->get_field_name(i) + " field failed.\n";
+          return NULL;
+        }
+      }
+    }
+    for (auto attr : extraAttributes) {
       OGRFieldDefn oField(attr.first.c_str(), attr.second.first);
       if (layer->CreateField(&oField) != OGRERR_NONE) {
         std::cerr << "Creating " + attr.first + " field failed.\n";
@@ -572,10 +970,15 @@ void Map3d::add_elevation_point(liblas::Point const& laspt) {
   else
     lasclass = LAS_UNKNOWN;
 
+  add_elevation_point(p, laspt.GetZ(), lasclass, (laspt.GetReturnNumber() == laspt.GetNumberOfReturns()));
+}
+
+//-- gives the point to the features (in the R-tree) within the radius
+void Map3d::add_elevation_point(Point2& p, double z, LAS14Class lasclass, bool lastreturn) {
   std::vector<PairIndexed> re;
   float radius = std::max(_radius_vertex_elevation, _building_radius_vertex_elevation);
-  Point2 minp(laspt.GetX() - radius, laspt.GetY() - radius);
-  Point2 maxp(laspt.GetX() + radius, laspt.GetY() + radius);
+  Point2 minp(p.x() - radius, p.y() - radius);
+  Point2 maxp(p.x() + radius, p.y() + radius);
   Box2 querybox(minp, maxp);
   _rtree.query(bgi::intersects(querybox), std::back_inserter(re));
 
@@ -588,11 +991,54 @@ void Map3d::add_elevation_point(liblas::Point const& laspt) {
       radius = _radius_vertex_elevation;
     }
     f->add_elevation_point(p,
-      laspt.GetZ(),
+      z,
       radius,
       lasclass,
-      (laspt.GetReturnNumber() == laspt.GetNumberOfReturns()));
+      lastreturn);
+  }
+}
+
+//-- a block of points given from memory instead of a LAS file; the R-tree must be constructed.
+//-- The filters of the LAS files (classes, thinning) are left to the caller.
+void Map3d::add_elevation_points(const std::vector<ElevationPoint>& points) {
+  for (auto& pt : points) {
+    Point2 p(pt.x, pt.y);
+    add_elevation_point(p, pt.z, pt.lasclass, pt.lastreturn);
+  }
+}
+
+//-- adds a feature given from memory instead of a file, in the layer layername. The attributes
+//-- of the features of a layer are stored in one table, with the fields of its first feature.
+//-- False if the lifting class is unknown; a polygon outside the requested extent is skipped.
+bool Map3d::add_polygon(const Polygon2& polygon, std::string id, std::string lifting, std::string layername, const AttributeMap& attributes) {
+  if (boost::geometry::area(_requestedExtent) > 0 && bg::intersects(polygon, _requestedExtent) == false)
+    return true;
+  AttributeTable* table;
+  auto it = _memorytables.find(layername);
+  if (it == _memorytables.end()) {
+    table = new AttributeTable(attributes);
+    _attributetables.push_back(table);
+    _memorytables[layername] = table;
+  }
+  else
+    table = it->second;
+  Polygon2* p2 = new Polygon2(polygon);
+  bg::unique(*p2); //-- remove duplicate vertices
+  bg::correct(*p2); //-- correct the orientation of the polygons!
+  TopoFeature* p3 = create_topofeature(p2, id, layername, table, table->add_row(attributes), lifting);
+  if (p3 == nullptr) {
+    std::cerr << "ERROR: lifting class '" << lifting << "' unknown (feature " << id << ")\n";
+    return false;
   }
+  _lsFeatures.push_back(p3);
+  return true;
+}
+
+//-- the callback gets each feature of the tile (all of them if there are no tiles) as soon as its
+//-- CDT is built; it is called from the worker threads, one call at a time. The feature belongs
+//-- to the map, it is valid until the features are cleared.
+void Map3d::set_feature_callback(FeatureCallback callback) {
+  _featurecallback = callback;
 }
 
 bool Map3d::threeDfy(bool stitching) {
@@ -605,17 +1051,22 @@ bool Map3d::threeDfy(bool stitching) {
   std::clog << "===== /LIFTING =====\n";
   for (auto& f : _lsFeatures) {
     f->lift();
+    f->release_lifting_data();
   }
+  print_memory_stage("lifting");
   std::clog << "===== LIFTING/ =====\n";
   if (stitching == true) {
     std::clog << "=====  /ADJACENT FEATURES =====\n";
     for (auto& f : _lsFeatures) {
+      f->build_vertex_index();
       this->collect_adjacent_features(f);
     }
+    print_memory_stage("adjacent features");
     std::clog << "=====  ADJACENT FEATURES/ =====\n";
 
     std::clog << "=====  /STITCHING =====\n";
     this->stitch_lifted_features();
+    print_memory_stage("stitching");
     std::clog << "=====  STITCHING/ =====\n";
 
     //-- Sort all node column vectors
@@ -623,44 +1074,111 @@ bool Map3d::threeDfy(bool stitching) {
       std::sort(nc.second.begin(), nc.second.end());
     }
 
+    std::vector<TopoFeature*> lsvw;
+    for (auto& f : _lsFeatures) {
+      if (f->has_vertical_walls() == true)
+        lsvw.push_back(f);
+    }
+
     std::clog << "=====  /BOWTIES =====\n";
     // TODO: shouldn't bowties be fixed after the VW? or at same time?
-    for (auto& f : _lsFeatures) {
-      if (f->has_vertical_walls() == true) {
-        f->fix_bowtie();
-      }
+    //-- fix_bowtie() modifies the elevations of the adjacent features too, so only
+    //-- features that do not share any adjacent feature are processed concurrently
+    for (auto& batch : this->batch_independent_features(lsvw)) {
+      parallel_for(batch.size(), [&batch](std::size_t i) {
+        batch[i]->fix_bowtie();
+      }, _number_of_threads);
     }
+    print_memory_stage("bowties");
     std::clog << "=====  BOWTIES/ =====\n";
 
     std::clog << "=====  /VERTICAL WALLS =====\n";
-    for (auto& f : _lsFeatures) {
-      if (f->has_vertical_walls() == true) {
-        int baseheight = 0;
-        if (f->get_class() == BUILDING) {
-          baseheight = dynamic_cast<Building*>(f)->get_height_base();
-        }
-        f->construct_vertical_walls(_nc, baseheight);
+    //-- each feature only reads _nc and the elevations, and writes its own walls
+    parallel_for(lsvw.size(), [this, &lsvw](std::size_t i) {
+      TopoFeature* f = lsvw[i];
+      int baseheight = 0;
+      if (f->get_class() == BUILDING) {
+        baseheight = dynamic_cast<Building*>(f)->get_height_base();
       }
-    }
+      f->construct_vertical_walls(_nc, baseheight);
+    }, _number_of_threads);
+    //-- the node columns and the adjacencies are not needed anymore
+    NodeColumn().swap(_nc);
+    for (auto& f : _lsFeatures)
+      f->release_adjacency();
+    print_memory_stage("vertical walls");
     std::clog << "=====  VERTICAL WALLS/ =====\n";
   }
+  //-- all LiDAR points are assigned and the adjacencies are known
+  _rtree.clear();
   return true;
 }
 
+//-- splits the features into batches such that, within a batch, no two features are
+//-- adjacent or share an adjacent feature. A feature goes in the batch after the last one
+//-- that reads or modifies its neighbourhood, so that two features in conflict are processed
+//-- in their input order, as in a serial loop.
+std::vector< std::vector<TopoFeature*> > Map3d::batch_independent_features(const std::vector<TopoFeature*>& features) {
+  std::vector< std::vector<TopoFeature*> > batches;
+  //-- for each feature, the last batch in which it is read or modified
+  std::unordered_map< TopoFeature*, int > claimed;
+  for (auto& f : features) {
+    std::vector<TopoFeature*> neighbourhood(*(f->get_adjacent_features()));
+    neighbourhood.push_back(f);
+    int b = 0;
+    for (auto& g : neighbourhood) {
+      auto it = claimed.find(g);
+      if (it != claimed.end())
+        b = std::max(b, it->second + 1);
+    }
+    if (b == batches.size())
+      batches.push_back(std::vector<TopoFeature*>());
+    batches[b].push_back(f);
+    for (auto& g : neighbourhood)
+      claimed[g] = b;
+  }
+  return batches;
+}
+
 bool Map3d::construct_CDT() {
   std::clog << "=====  /CDT =====\n";
-  for (auto& p : _lsFeatures) {
-    // std::clog << p->get_id() << " (" << p->get_class() << ")\n";
-    p->buildCDT();
-  }
+  //-- each feature has its own CDT: build them in parallel, the biggest ones first
+  std::vector< std::pair<unsigned long, TopoFeature*> > jobs;
+  jobs.reserve(_lsFeatures.size());
+  for (auto& p : _lsFeatures)
+    jobs.push_back(std::make_pair(p->get_number_cdt_points(), p));
+  std::stable_sort(jobs.begin(), jobs.end(),
+    [](std::pair<unsigned long, TopoFeature*> const &a, std::pair<unsigned long, TopoFeature*> const &b) {
+    return a.first > b.first;
+  });
+  parallel_for(jobs.size(), [this, &jobs](std::size_t i) {
+    jobs[i].second->buildCDT();
+    if (_featurecallback && is_in_tile(jobs[i].second) == true) {
+      std::lock_guard<std::mutex> lock(_callbackmutex);
+      _featurecallback(jobs[i].second);
+    }
+  }, _number_of_threads);
+  print_memory_stage("CDT");
   std::clog << "=====  CDT/ =====\n";
   return true;
 }
 
+//-- the tree is static once the polygons are read: it is bulk-loaded (packing algorithm),
+//-- which is faster than inserting one by one and gives a tree with less overlap
 bool Map3d::construct_rtree() {
+  return construct_rtree(_lsFeatures);
+}
+
+//-- with only some of the features (the changed ones in incremental mode), the points are
+//-- assigned to those only and the LAS files that do not overlap them are skipped
+bool Map3d::construct_rtree(const std::vector<TopoFeature*>& features) {
   std::clog << "Constructing the R-tree...";
-  for (auto p : _lsFeatures)
-    _rtree.insert(std::make_pair(p->get_bbox2d(), p));
+  std::vector<PairIndexed> entries(features.size());
+  parallel_for(features.size(), [&features, &entries](std::size_t i) {
+    features[i]->compute_bbox2d();
+    entries[i] = std::make_pair(features[i]->get_bbox2d(), features[i]);
+  }, _number_of_threads);
+  bgi::rtree< PairIndexed, bgi::rstar<16> >(entries.begin(), entries.end()).swap(_rtree);
   std::clog << " done.\n";
 
   //-- update the bounding box from the r-tree
@@ -678,21 +1196,19 @@ bool Map3d::add_polygons_files(std::vector<PolygonFile> &files) {
     GDALAllRegister();
 #endif
 
+  //-- one job per layer of each file; for the files without layers specified, add all
+  std::vector< std::pair<PolygonFile*, int> > jobs;
   for (auto file = files.begin(); file != files.end(); ++file) {
-    std::clog << "Reading input dataset: " << file->filename << std::endl;
+    if (file->layers[0].first.empty()) {
 #if GDAL_VERSION_MAJOR < 2
-    OGRDataSource *dataSource = OGRSFDriverRegistrar::Open(file->filename.c_str(), false);
+      OGRDataSource *dataSource = OGRSFDriverRegistrar::Open(file->filename.c_str(), false);
 #else
-    GDALDataset *dataSource = (GDALDataset*)GDALOpenEx(file->filename.c_str(), GDAL_OF_READONLY, NULL, NULL, NULL);
+      GDALDataset *dataSource = (GDALDataset*)GDALOpenEx(file->filename.c_str(), GDAL_OF_READONLY, NULL, NULL, NULL);
 #endif
-
-    if (dataSource == NULL) {
-      std::cerr << "\tERROR: could not open file: " + file->filename << std::endl;
-      return false;
-    }
-
-    // if the file doesn't have layers specified, add all
-    if (file->layers[0].first.empty()) {
+      if (dataSource == NULL) {
+        std::cerr << "\tERROR: could not open file: " + file->filename << std::endl;
+        return false;
+      }
       std::string lifting = file->layers[0].second;
       file->layers.clear();
       int numberOfLayers = dataSource->GetLayerCount();
@@ -700,93 +1216,193 @@ bool Map3d::add_polygons_files(std::vector<PolygonFile> &files) {
         OGRLayer *dataLayer = dataSource->GetLayer(i);
         file->layers.emplace_back(dataLayer->GetName(), lifting);
       }
-    }
-    bool wentgood = this->extract_and_add_polygon(dataSource, &(*file));
 #if GDAL_VERSION_MAJOR < 2
-    OGRDataSource::DestroyDataSource(dataSource);
+      OGRDataSource::DestroyDataSource(dataSource);
 #else
-    GDALClose(dataSource);
+      GDALClose(dataSource);
 #endif
-
-    if (!wentgood) {
+    }
+    if (file->layers.empty() == true) {
+      std::cerr << "\tERROR: no layers in file: " + file->filename << std::endl;
       return false;
     }
+    for (int i = 0; i < int(file->layers.size()); i++)
+      jobs.push_back(std::make_pair(&(*file), i));
   }
-  return true;
+
+  //-- the layers are read in parallel, each with its own handle on the dataset,
+  //-- and merged afterwards in the order of the input so that the output is reproducible
+  std::vector<LayerFeatures> results(jobs.size());
+  parallel_for(jobs.size(), [this, &jobs, &results](std::size_t i) {
+    this->extract_and_add_polygon(jobs[i].first, jobs[i].first->layers[jobs[i].second], results[i]);
+  }, _number_of_threads);
+
+  bool wentgood = true;
+  bool filegood = false;
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    PolygonFile* file = jobs[i].first;
+    LayerFeatures& result = results[i];
+    if (jobs[i].second == 0) {
+      std::clog << "Reading input dataset: " << file->filename << std::endl;
+      filegood = false;
+    }
+    std::clog << result.log;
+    std::cerr << result.errors;
+    if (result.attributes != NULL)
+      _attributetables.push_back(result.attributes);
+    _lsFeatures.insert(_lsFeatures.end(), result.features.begin(), result.features.end());
+    if (result.status == LayerFeatures::FAILED)
+      wentgood = false;
+    if (result.status == LayerFeatures::READ)
+      filegood = true;
+    //-- a file is valid if at least one of its layers was read
+    if (jobs[i].second == int(file->layers.size()) - 1 && filegood == false)
+      wentgood = false;
+  }
+  return wentgood;
 }
 
+//-- extent of the layers of the files (as given by the driver, without reading the features),
+//-- limited to the requested extent if there is one
+bool Map3d::get_polygons_extent(std::vector<PolygonFile> &files, Box2& extent) {
+#if GDAL_VERSION_MAJOR < 2
+  if (OGRSFDriverRegistrar::GetRegistrar()->GetDriverCount() == 0)
+    OGRRegisterAll();
+#else
+  if (GDALGetDriverCount() == 0)
+    GDALAllRegister();
+#endif
+  OGREnvelope envelope;
+  bool found = false;
+  for (auto& file : files) {
 #if GDAL_VERSION_MAJOR < 2
-bool Map3d::extract_and_add_polygon(OGRDataSource* dataSource, PolygonFile* file) {
+    OGRDataSource *dataSource = OGRSFDriverRegistrar::Open(file.filename.c_str(), false);
 #else
-bool Map3d::extract_and_add_polygon(GDALDataset* dataSource, PolygonFile* file) {
+    GDALDataset *dataSource = (GDALDataset*)GDALOpenEx(file.filename.c_str(), GDAL_OF_READONLY, NULL, NULL, NULL);
 #endif
+    if (dataSource == NULL) {
+      std::cerr << "\tERROR: could not open file: " + file.filename << std::endl;
+      return false;
+    }
+    std::vector<OGRLayer*> layers;
+    if (file.layers[0].first.empty()) {
+      for (int i = 0; i < dataSource->GetLayerCount(); i++)
+        layers.push_back(dataSource->GetLayer(i));
+    }
+    else {
+      for (auto& layer : file.layers) {
+        OGRLayer *dataLayer = dataSource->GetLayerByName(layer.first.c_str());
+        if (dataLayer != NULL)
+          layers.push_back(dataLayer);
+      }
+    }
+    for (auto& dataLayer : layers) {
+      OGREnvelope layerEnvelope;
+      if (dataLayer->GetExtent(&layerEnvelope, true) != OGRERR_NONE)
+        continue;
+      if (found == false)
+        envelope = layerEnvelope;
+      else
+        envelope.Merge(layerEnvelope);
+      found = true;
+    }
+#if GDAL_VERSION_MAJOR < 2
+    OGRDataSource::DestroyDataSource(dataSource);
+#else
+    GDALClose(dataSource);
+#endif
+  }
+  if (found == false) {
+    std::cerr << "\tERROR: could not get the extent of the polygons\n";
+    return false;
+  }
+  extent = Box2(Point2(envelope.MinX, envelope.MinY), Point2(envelope.MaxX, envelope.MaxY));
+  if (boost::geometry::area(_requestedExtent) > 0) {
+    Box2 requested;
+    if (bg::intersection(extent, _requestedExtent, requested) == false)
+      return false;
+    extent = requested;
+  }
+  return true;
+}
+
+//-- reads one layer of a file, with its own handle on the dataset so that it can run in
+//-- parallel with other layers. The features are not added to the map but to result.
+void Map3d::extract_and_add_polygon(PolygonFile* file, std::pair<std::string, std::string> layer, LayerFeatures& result) {
+  std::ostringstream log, errors;
   const char *idfield = file->idfield.c_str();
   const char *heightfield = file->heightfield.c_str();
   bool multiple_heights = file->handle_multiple_heights;
-  bool wentgood = false;
-  for (auto l : file->layers) {
-    OGRLayer *dataLayer = dataSource->GetLayerByName((l.first).c_str());
-    if (dataLayer == NULL) {
-      continue;
-    }
+  result.status = LayerFeatures::NOT_FOUND;
+  if (file->cache == true && read_polygon_cache(file, layer, result) == true)
+    return;
+#if GDAL_VERSION_MAJOR < 2
+  OGRDataSource *dataSource = OGRSFDriverRegistrar::Open(file->filename.c_str(), false);
+#else
+  GDALDataset *dataSource = (GDALDataset*)GDALOpenEx(file->filename.c_str(), GDAL_OF_READONLY, NULL, NULL, NULL);
+#endif
+  if (dataSource == NULL) {
+    errors << "\tERROR: could not open file: " + file->filename << std::endl;
+    result.status = LayerFeatures::FAILED;
+    result.errors = errors.str();
+    return;
+  }
+  OGRLayer *dataLayer = dataSource->GetLayerByName((layer.first).c_str());
+  if (dataLayer != NULL) {
     if (dataLayer->FindFieldIndex(idfield, false) == -1) {
-      std::cerr << "ERROR: field '" << idfield << "' not found in layer '" << l.first << "'.\n";
-      return false;
+      errors << "ERROR: field '" << idfield << "' not found in layer '" << layer.first << "'.\n";
+      result.status = LayerFeatures::FAILED;
     }
-    if (dataLayer->FindFieldIndex(heightfield, false) == -1) {
-      std::clog << "Warning: field '" << heightfield << "' not found in layer '" << l.first << "', using all polygons.\n";
-    }
-    dataLayer->ResetReading();
-    unsigned int numberOfPolygons = dataLayer->GetFeatureCount(true);
-    std::string layerName = dataLayer->GetName();
-    std::clog << "\tLayer: " << layerName << std::endl;
-    std::clog << "\t(" << boost::locale::as::number << numberOfPolygons << " features --> " << l.second << ")\n";
-    OGRFeature *f;
-
-    //-- check if extent is given and polygons need filtering
-    bool useRequestedExtent = false;
-    OGREnvelope envelope = OGREnvelope();
-    if (boost::geometry::area(_requestedExtent) > 0) {
-      envelope.MinX = bg::get<bg::min_corner, 0>(_requestedExtent);
-      envelope.MaxX = bg::get<bg::max_corner, 1>(_requestedExtent);
-      envelope.MinY = bg::get<bg::min_corner, 0>(_requestedExtent);
-      envelope.MaxY = bg::get<bg::max_corner, 1>(_requestedExtent);
-      useRequestedExtent = true;
-    }
-
-    int numSplitMulti = 0;
-    int numSplitPoly = 0;
-    while ((f = dataLayer->GetNextFeature()) != NULL) {
-      OGRGeometry *geometry = f->GetGeometryRef();
-      if (!geometry->IsValid()) {
-        std::cerr << "Geometry invalid: " << f->GetFieldAsString(idfield) << std::endl;
+    else {
+      if (dataLayer->FindFieldIndex(heightfield, false) == -1) {
+        log << "Warning: field '" << heightfield << "' not found in layer '" << layer.first << "', using all polygons.\n";
       }
-      OGREnvelope env;
-      if (useRequestedExtent) {
-        geometry->getEnvelope(&env);
+      //-- if an extent is given, let the driver filter the features (with its spatial index if it has one)
+      if (boost::geometry::area(_requestedExtent) > 0) {
+        dataLayer->SetSpatialFilterRect(bg::get<bg::min_corner, 0>(_requestedExtent), bg::get<bg::min_corner, 1>(_requestedExtent),
+                                        bg::get<bg::max_corner, 0>(_requestedExtent), bg::get<bg::max_corner, 1>(_requestedExtent));
       }
-
-      //-- add the polygon of no extent is used or if the envelope is within the extent
-      if (!useRequestedExtent || envelope.Intersects(env)) {
+      dataLayer->ResetReading();
+      unsigned int numberOfPolygons = dataLayer->GetFeatureCount(true);
+      std::string layerName = dataLayer->GetName();
+      log << "\tLayer: " << layerName << std::endl;
+      log << "\t(" << boost::locale::as::number << numberOfPolygons << " features --> " << layer.second << ")\n";
+      OGRFeature *f;
+      AttributeTable* attributes = new AttributeTable(dataLayer->GetLayerDefn());
+      result.attributes = attributes;
+
+      int numSplitMulti = 0;
+      int numSplitPoly = 0;
+      while ((f = dataLayer->GetNextFeature()) != NULL) {
+        OGRGeometry *geometry = f->GetGeometryRef();
+        if (!geometry->IsValid()) {
+          errors << "Geometry invalid: " << f->GetFieldAsString(idfield) << std::endl;
+        }
         switch (geometry->getGeometryType()) {
         case wkbPolygon:
         case wkbPolygon25D: {
-          extract_feature(f, layerName, idfield, heightfield, l.second, multiple_heights);
+          std::size_t row = attributes->add_row(f);
+          TopoFeature* p3 = extract_feature(f, (OGRPolygon*)geometry, f->GetFieldAsString(idfield), layerName, attributes, row, heightfield, layer.second, multiple_heights);
+          if (p3 != nullptr)
+            result.features.push_back(p3);
           break;
         }
         case wkbMultiPolygon:
         case wkbMultiPolygon25D: {
+          //-- each part becomes a feature with the same attributes, and "-i" appended to its id if there are many
           OGRMultiPolygon* multipolygon = (OGRMultiPolygon*)geometry;
           int numGeom = multipolygon->getNumGeometries();
           if (numGeom >= 1) {
+            std::string id = f->GetFieldAsString(idfield);
+            int idfieldi = f->GetFieldIndex(idfield);
             for (int i = 0; i < numGeom; i++) {
-              OGRFeature* cf = f->Clone();
-              if (numGeom > 1) {
-                std::string idString = (std::string)f->GetFieldAsString(idfield) + "-" + std::to_string(i);
-                cf->SetField(idfield, idString.c_str());
-              }
-              cf->SetGeometry((OGRPolygon*)multipolygon->getGeometryRef(i));
-              extract_feature(cf, layerName, idfield, heightfield, l.second, multiple_heights);
+              std::string idString = id;
+              if (numGeom > 1)
+                idString += "-" + std::to_string(i);
+              std::size_t row = attributes->add_row(f, idfieldi, idString);
+              TopoFeature* p3 = extract_feature(f, (OGRPolygon*)multipolygon->getGeometryRef(i), idString, layerName, attributes, row, heightfield, layer.second, multiple_heights);
+              if (p3 != nullptr)
+                result.features.push_back(p3);
             }
             numSplitMulti++;
             numSplitPoly += numGeom;
@@ -794,67 +1410,236 @@ bool Map3d::extract_and_add_polygon(GDALDataset* dataSource, PolygonFile* file)
           break;
         }
         default: {
-          continue;
+          break;
         }
         }
+        OGRFeature::DestroyFeature(f);
       }
+      if (numSplitMulti > 0) {
+        log << "\tSplit " << numSplitMulti << " MultiPolygon(s) into " << numSplitPoly << " Polygon(s)\n";
+      }
+      result.status = LayerFeatures::READ;
     }
-    if (numSplitMulti > 0) {
-      std::clog << "\tSplit " << numSplitMulti << " MultiPolygon(s) into " << numSplitPoly << " Polygon(s)\n";
-    }
-    wentgood = true;
   }
-  return wentgood;
+#if GDAL_VERSION_MAJOR < 2
+  OGRDataSource::DestroyDataSource(dataSource);
+#else
+  GDALClose(dataSource);
+#endif
+  if (file->cache == true && result.status == LayerFeatures::READ) {
+    if (write_polygon_cache(file, layer, result) == true)
+      log << "\t(cache written: " << get_polygon_cache_filename(file, layer) << ")\n";
+    else
+      errors << "Warning: could not write the cache of layer '" << layer.first << "'.\n";
+  }
+  result.log = log.str();
+  result.errors = errors.str();
 }
 
-void Map3d::extract_feature(OGRFeature *f, std::string layername, const char *idfield, const char *heightfield, std::string layertype, bool multiple_heights) {
-  char *wkt;
-  OGRGeometry *geom = f->GetGeometryRef();
-  geom->flattenTo2D();
-  geom->exportToWkt(&wkt);
-  AttributeMap attributes;
-  int attributeCount = f->GetFieldCount();
-  for (int i = 0; i < attributeCount; i++) {
-    attributes[boost::locale::to_lower(f->GetFieldDefnRef(i)->GetNameRef())] = std::make_pair(f->GetFieldDefnRef(i)->GetType(), f->GetFieldAsString(i));
+TopoFeature* Map3d::extract_feature(OGRFeature *f, OGRPolygon* polygon, std::string id, std::string layername, AttributeTable* attributes, std::size_t attributerow, const char *heightfield, std::string layertype, bool multiple_heights) {
+  Polygon2* p2 = new Polygon2();
+  ogr_to_polygon2(polygon, *p2);
+  bg::unique(*p2); //-- remove duplicate vertices
+  bg::correct(*p2); //-- correct the orientation of the polygons!
+  TopoFeature* p3 = create_topofeature(p2, id, layername, attributes, attributerow, layertype);
+  if (p3 == nullptr)
+    return nullptr;
+  //-- flag all polygons at (niveau != 0) or remove if not handling multiple height levels
+  if ((f->GetFieldIndex(heightfield) != -1) && (f->GetFieldAsInteger(heightfield) != 0)) {
+    if (multiple_heights) {
+      // std::clog << "niveau=" << f->GetFieldAsInteger(heightfield) << ": " << id << std::endl;
+      p3->set_top_level(false);
+    }
+    else {
+      p3->~TopoFeature(); //-- its memory stays in the arena until clear_features()
+      return nullptr;
+    }
   }
+  return p3;
+}
+
+//-- creates the feature of the lifting class layertype, it takes ownership of p2 (deleted if the class is unknown)
+TopoFeature* Map3d::create_topofeature(Polygon2* p2, std::string id, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string layertype) {
+  TopoFeature* p3;
   if (layertype == "Building") {
-    Building* p3 = new Building(wkt, layername, attributes, f->GetFieldAsString(idfield), _building_heightref_roof, _building_heightref_floor);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Building>(p2, layername, attributes, attributerow, id, _building_heightref_roof, _building_heightref_floor);
   }
   else if (layertype == "Terrain") {
-    Terrain* p3 = new Terrain(wkt, layername, attributes, f->GetFieldAsString(idfield), this->_terrain_simplification, this->_terrain_innerbuffer);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Terrain>(p2, layername, attributes, attributerow, id, this->_terrain_simplification, this->_terrain_innerbuffer, this->_terrain_simplification_tinsimp, this->_terrain_max_points);
   }
   else if (layertype == "Forest") {
-    Forest* p3 = new Forest(wkt, layername, attributes, f->GetFieldAsString(idfield), this->_forest_simplification, this->_forest_innerbuffer, this->_forest_ground_points_only);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Forest>(p2, layername, attributes, attributerow, id, this->_forest_simplification, this->_forest_innerbuffer, this->_forest_ground_points_only, this->_forest_simplification_tinsimp, this->_forest_max_points);
   }
   else if (layertype == "Water") {
-    Water* p3 = new Water(wkt, layername, attributes, f->GetFieldAsString(idfield), this->_water_heightref);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Water>(p2, layername, attributes, attributerow, id, this->_water_heightref);
   }
   else if (layertype == "Road") {
-    Road* p3 = new Road(wkt, layername, attributes, f->GetFieldAsString(idfield), this->_road_heightref);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Road>(p2, layername, attributes, attributerow, id, this->_road_heightref);
   }
   else if (layertype == "Separation") {
-    Separation* p3 = new Separation(wkt, layername, attributes, f->GetFieldAsString(idfield), this->_separation_heightref);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Separation>(p2, layername, attributes, attributerow, id, this->_separation_heightref);
   }
   else if (layertype == "Bridge/Overpass") {
-    Bridge* p3 = new Bridge(wkt, layername, attributes, f->GetFieldAsString(idfield), this->_bridge_heightref);
-    _lsFeatures.push_back(p3);
+    p3 = create_feature<Bridge>(p2, layername, attributes, attributerow, id, this->_bridge_heightref);
   }
-  //-- flag all polygons at (niveau != 0) or remove if not handling multiple height levels
-  if ((f->GetFieldIndex(heightfield) != -1) && (f->GetFieldAsInteger(heightfield) != 0)) {
-    if (multiple_heights) {
-      // std::clog << "niveau=" << f->GetFieldAsInteger(heightfield) << ": " << f->GetFieldAsString(idfield) << std::endl;
-      _lsFeatures.back()->set_top_level(false);
+  else {
+    delete p2;
+    return nullptr;
+  }
+  return p3;
+}
+
+//-- the cache of a layer is only valid for the same input file (size and time of last modification)
+//-- and the same reading options; extent and heightfield change which features are kept
+std::string Map3d::get_polygon_cache_key(PolygonFile* file, std::pair<std::string, std::string> layer) {
+  std::ostringstream key;
+  key << std::setprecision(17);
+  key << file->filename << "|" << boost::filesystem::file_size(file->filename) << "|" << boost::filesystem::last_write_time(file->filename);
+  key << "|" << layer.first << "|" << layer.second << "|" << file->idfield << "|" << file->heightfield << "|" << file->handle_multiple_heights;
+  key << "|" << bg::get<bg::min_corner, 0>(_requestedExtent) << "|" << bg::get<bg::min_corner, 1>(_requestedExtent);
+  key << "|" << bg::get<bg::max_corner, 0>(_requestedExtent) << "|" << bg::get<bg::max_corner, 1>(_requestedExtent);
+  return key.str();
+}
+
+//-- the cache is next to the input file, one per layer and reading settings:
+//-- "<file.ext>_<layer>_<hash>.3dfcache". The hash (FNV-1a, 64 bits) is that of what the polygons
+//-- read depend on except the state of the file and the extent (those of the key), so that two
+//-- entries of the config never share a cache (or its temporary file) and the cache of an entry
+//-- is replaced when its file changes.
+std::string Map3d::get_polygon_cache_filename(PolygonFile* file, std::pair<std::string, std::string> layer) {
+  std::string layername = layer.first;
+  for (auto& c : layername) {
+    if (std::isalnum((unsigned char)c) == false && c != '-' && c != '_')
+      c = '_';
+  }
+  std::ostringstream identity;
+  identity << file->filename << "|" << layer.first << "|" << layer.second << "|" << file->idfield << "|" << file->heightfield << "|" << file->handle_multiple_heights;
+  std::uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : identity.str()) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  std::ostringstream name;
+  name << file->filename << "_" << layername << "_" << std::hex << std::setw(16) << std::setfill('0') << h << ".3dfcache";
+  return name.str();
+}
+
+//-- reads the features of a layer from its cache, false (and result untouched) if there is
+//-- no valid cache, in which case the layer has to be read with OGR
+bool Map3d::read_polygon_cache(PolygonFile* file, std::pair<std::string, std::string> layer, LayerFeatures& result) {
+  boost::system::error_code ec;
+  if (boost::filesystem::is_regular_file(file->filename, ec) == false)
+    return false;
+  std::string filename = get_polygon_cache_filename(file, layer);
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (ifs.is_open() == false)
+    return false;
+  std::string magic, key, layerName;
+  if (read_binary_string(ifs, magic) == false || magic != "3DFCACH2" ||
+      read_binary_string(ifs, key) == false || key != get_polygon_cache_key(file, layer) ||
+      read_binary_string(ifs, layerName) == false)
+    return false;
+  AttributeTable* attributes = new AttributeTable();
+  unsigned long long numberOfFeatures;
+  if (attributes->read(ifs) == false || read_binary(ifs, numberOfFeatures) == false) {
+    delete attributes;
+    return false;
+  }
+  std::vector<TopoFeature*> features;
+  bool wentgood = true;
+  for (unsigned long long fi = 0; fi < numberOfFeatures && wentgood; fi++) {
+    std::string id;
+    unsigned long long row, numberOfRings;
+    bool toplevel;
+    if (read_binary_string(ifs, id) == false || read_binary(ifs, row) == false || row >= attributes->get_number_rows() ||
+        read_binary(ifs, toplevel) == false || read_binary(ifs, numberOfRings) == false || numberOfRings == 0) {
+      wentgood = false;
+      break;
     }
-    else {
-      _lsFeatures.pop_back();
+    //-- the polygons were corrected before being written, they are used as is
+    Polygon2* p2 = new Polygon2();
+    p2->inners().resize(numberOfRings - 1);
+    for (unsigned long long ri = 0; ri < numberOfRings && wentgood; ri++) {
+      Ring2& ring = (ri == 0) ? p2->outer() : p2->inners()[ri - 1];
+      unsigned long long numberOfPoints;
+      if (read_binary(ifs, numberOfPoints) == false) {
+        wentgood = false;
+        break;
+      }
+      for (unsigned long long pi = 0; pi < numberOfPoints; pi++) {
+        double x, y;
+        if (read_binary(ifs, x) == false || read_binary(ifs, y) == false) {
+          wentgood = false;
+          break;
+        }
+        ring.push_back(Point2(x, y));
+      }
+    }
+    TopoFeature* p3 = wentgood ? create_topofeature(p2, id, layerName, attributes, row, layer.second) : nullptr;
+    if (p3 == nullptr) {
+      if (wentgood == false)
+        delete p2;
+      wentgood = false;
+      break;
+    }
+    p3->set_top_level(toplevel);
+    features.push_back(p3);
+  }
+  if (wentgood == false) {
+    for (auto& f : features)
+      f->~TopoFeature(); //-- its memory stays in the arena until clear_features()
+    delete attributes;
+    return false;
+  }
+  std::ostringstream log;
+  log << "\tLayer: " << layerName << std::endl;
+  log << "\t(" << boost::locale::as::number << features.size() << " features --> " << layer.second << ", read from cache)\n";
+  result.log = log.str();
+  result.attributes = attributes;
+  result.features = features;
+  result.status = LayerFeatures::READ;
+  return true;
+}
+
+//-- writes the features of a layer read with OGR to its cache, to a temporary file first
+//-- so that an interrupted run never leaves a truncated cache behind
+bool Map3d::write_polygon_cache(PolygonFile* file, std::pair<std::string, std::string> layer, LayerFeatures& result) {
+  boost::system::error_code ec;
+  if (boost::filesystem::is_regular_file(file->filename, ec) == false || result.attributes == NULL)
+    return false;
+  std::string filename = get_polygon_cache_filename(file, layer);
+  std::string tmpfilename = filename + ".tmp";
+  std::ofstream ofs(tmpfilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (ofs.is_open() == false)
+    return false;
+  std::string layerName = result.features.empty() ? layer.first : result.features.front()->get_layername();
+  write_binary_string(ofs, "3DFCACH2");
+  write_binary_string(ofs, get_polygon_cache_key(file, layer));
+  write_binary_string(ofs, layerName);
+  result.attributes->write(ofs);
+  write_binary(ofs, (unsigned long long)result.features.size());
+  for (auto& f : result.features) {
+    Polygon2* p2 = f->get_Polygon2();
+    write_binary_string(ofs, f->get_id());
+    write_binary(ofs, (unsigned long long)f->get_attribute_row());
+    write_binary(ofs, f->get_top_level());
+    write_binary(ofs, (unsigned long long)(p2->inners().size() + 1));
+    for (int ri = 0; ri <= int(p2->inners().size()); ri++) {
+      Ring2& ring = (ri == 0) ? p2->outer() : p2->inners()[ri - 1];
+      write_binary(ofs, (unsigned long long)ring.size());
+      for (auto& p : ring) {
+        write_binary(ofs, p.x());
+        write_binary(ofs, p.y());
+      }
     }
   }
+  ofs.close();
+  if (ofs.fail() == true) {
+    boost::filesystem::remove(tmpfilename, ec);
+    return false;
+  }
+  boost::filesystem::rename(tmpfilename, filename, ec);
+  return !ec;
 }
 
 //-- http://www.liblas.org/tutorial/cpp.html#applying-filters-to-a-reader-to-extract-specified-classes
@@ -39,23 +39,64 @@
 #include "Road.h"
 #include "Separation.h"
 #include "Bridge.h"
+#include "arena.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
 
 typedef std::pair<Box2, TopoFeature*> PairIndexed;
 
+//-- what was read from one layer of an input file
+typedef struct LayerFeatures {
+  enum { NOT_FOUND, READ, FAILED } status = NOT_FOUND;
+  AttributeTable*            attributes = NULL;
+  std::vector<TopoFeature*>  features;
+  std::string                log;
+  std::string                errors;
+} LayerFeatures;
+
+//-- a point given from memory (see add_elevation_points)
+typedef struct ElevationPoint {
+  double     x;
+  double     y;
+  double     z;
+  LAS14Class lasclass;
+  bool       lastreturn;
+} ElevationPoint;
+
+//-- called with each feature once it is lifted and triangulated, see set_feature_callback()
+typedef std::function<void(TopoFeature*)> FeatureCallback;
+
 class Map3d {
 public:
   Map3d();
   ~Map3d();
 
   bool add_polygons_files(std::vector<PolygonFile> &files);
+  bool get_polygons_extent(std::vector<PolygonFile> &files, Box2& extent);
   bool add_las_file(PointFile pointFile);
+  bool add_polygon(const Polygon2& polygon, std::string id, std::string lifting, std::string layername, const AttributeMap& attributes = AttributeMap());
+  void add_elevation_points(const std::vector<ElevationPoint>& points);
+  void set_feature_callback(FeatureCallback callback);
 
   void stitch_lifted_features();
+  static std::vector< std::vector<TopoFeature*> > batch_independent_features(const std::vector<TopoFeature*>& features);
   bool construct_rtree();
+  bool construct_rtree(const std::vector<TopoFeature*>& features);
   bool threeDfy(bool stitching = true);
   bool construct_CDT();
   void add_elevation_point(liblas::Point const& laspt);
 
+  void clear_features();
+  std::string get_snapshot_polygons_key(std::vector<PolygonFile> &polygonFiles);
+  std::string get_snapshot_points_key(std::vector<PointFile> &pointFiles);
+  bool write_snapshot(std::string filename, std::string polygonskey, std::string pointskey);
+  bool read_snapshot(std::string filename, std::string polygonskey, std::string pointskey);
+  bool add_polygons_files_incremental(std::vector<PolygonFile> &files, std::string snapshot, std::string pointskey, std::vector<TopoFeature*>& dirty);
+  bool add_features_from(Map3d& source);
+  void remove_features_outside_tile();
+  bool check_tile_halo();
+  void print_memory_usage();
   unsigned long get_num_polygons();
   const std::vector<TopoFeature*>&  get_polygons3d();
   Box2 get_bbox();
@@ -83,6 +124,10 @@ public:
   void set_building_lod(int lod);
   void set_terrain_simplification(int simplification);
   void set_forest_simplification(int simplification);
+  void set_terrain_simplification_tinsimp(double threshold);
+  void set_forest_simplification_tinsimp(double threshold);
+  void set_terrain_max_points(unsigned long max_points);
+  void set_forest_max_points(unsigned long max_points);
   void set_terrain_innerbuffer(float innerbuffer);
   void set_forest_innerbuffer(float innerbuffer);
   void set_forest_ground_points_only(bool only_ground_points);
@@ -95,6 +140,9 @@ public:
   void set_threshold_jump_edges(float threshold);
   void set_use_vertical_walls(bool useverticalwalls);
   void set_requested_extent(double xmin, double ymin, double xmax, double ymax);
+  void set_tile(double xmin, double ymin, double xmax, double ymax, double halo);
+  void set_number_of_threads(int threads);
+  void set_validate_cdt(bool validate);
 private:
   float       _building_heightref_roof;
   float       _building_heightref_floor;
@@ -104,6 +152,10 @@ private:
   bool        _use_vertical_walls;
   int         _terrain_simplification;
   int         _forest_simplification;
+  double      _terrain_simplification_tinsimp;
+  double      _forest_simplification_tinsimp;
+  unsigned long _terrain_max_points;
+  unsigned long _forest_max_points;
   float       _terrain_innerbuffer;
   float       _forest_innerbuffer;
   bool        _forest_ground_points_only;
@@ -114,25 +166,47 @@ private:
   float       _radius_vertex_elevation;
   float       _building_radius_vertex_elevation;
   int         _threshold_jump_edges; //-- in cm/integer
+  int         _number_of_threads; //-- 0 is one per core
   Box2        _bbox;
   Box2        _requestedExtent;
+  Box2        _tile; //-- when processing by tiles, the features with their centroid outside are not written
 
   NodeColumn                                          _nc;
+  Arena                                               _arena; //-- holds all the TopoFeatures
   std::vector<TopoFeature*>                           _lsFeatures;
+  std::vector<AttributeTable*>                        _attributetables; //-- one per input layer
+  std::atomic<std::size_t>                            _featurebytes[7]; //-- size of the objects in the arena, per TopoClass
   std::vector<std::string>                            _allowed_layers;
   bgi::rtree< PairIndexed, bgi::rstar<16> >           _rtree;
-
-#if GDAL_VERSION_MAJOR < 2
-  bool extract_and_add_polygon(OGRDataSource* dataSource, PolygonFile* file);
-#else
-  bool extract_and_add_polygon(GDALDataset* dataSource, PolygonFile* file);
-  OGRLayer* create_gdal_layer(GDALDriver *driver, std::string filename, std::string layername, AttributeMap attributes, bool addHeightAttributes);
+  std::atomic<int>                                    _featurecounter;
+  std::unordered_map<std::string, AttributeTable*>    _memorytables; //-- of the layers given with add_polygon()
+  FeatureCallback                                     _featurecallback;
+  std::mutex                                          _callbackmutex; //-- the callback is called by one thread at a time
+
+  void add_elevation_point(Point2& p, double z, LAS14Class lasclass, bool lastreturn);
+  bool is_in_tile(TopoFeature* f);
+  void extract_and_add_polygon(PolygonFile* file, std::pair<std::string, std::string> layer, LayerFeatures& result);
+#if GDAL_VERSION_MAJOR >= 2
+  OGRLayer* create_gdal_layer(GDALDriver *driver, std::string filename, std::string layername, AttributeTable* attributes, bool addHeightAttributes, AttributeMap extraAttributes = AttributeMap());
 #endif
-  void extract_feature(OGRFeature * f, std::string layerName, const char * idfield, const char * heightfield, std::string layertype, bool multiple_heights);
+  TopoFeature* extract_feature(OGRFeature * f, OGRPolygon* polygon, std::string id, std::string layerName, AttributeTable* attributes, std::size_t attributerow, const char * heightfield, std::string layertype, bool multiple_heights);
+  TopoFeature* create_topofeature(Polygon2* p2, std::string id, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string layertype);
+  std::string get_polygon_cache_key(PolygonFile* file, std::pair<std::string, std::string> layer);
+  std::string get_polygon_cache_filename(PolygonFile* file, std::pair<std::string, std::string> layer);
+  bool read_polygon_cache(PolygonFile* file, std::pair<std::string, std::string> layer, LayerFeatures& result);
+  bool write_polygon_cache(PolygonFile* file, std::pair<std::string, std::string> layer, LayerFeatures& result);
   void stitch_one_vertex(TopoFeature* f, int ringi, int pi, std::vector< std::tuple<TopoFeature*, int, int> >& star);
   void stitch_jumpedge(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2);
   void stitch_average(TopoFeature* f1, int ringi1, int pi1, TopoFeature* f2, int ringi2, int pi2);
   void collect_adjacent_features(TopoFeature* f);
+
+  template <typename T, typename... Args>
+  T* create_feature(Args&&... args) {
+    T* f = _arena.create<T>(std::forward<Args>(args)...);
+    f->set_counter(_featurecounter++);
+    _featurebytes[f->get_class()] += sizeof(T);
+    return f;
+  }
 };
 
 #endif
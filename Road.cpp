@@ -29,10 +29,8 @@
 #include "Road.h"
 #include "io.h"
 
-float Road::_heightref = 0.5;
-
-Road::Road(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref)
-  : Boundary3D(wkt, layername, attributes, pid) {
+Road::Road(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref)
+  : Boundary3D(p2, layername, attributes, attributerow, pid) {
   _heightref = heightref;
 }
 
@@ -64,7 +62,7 @@ bool Road::lift() {
 void Road::get_citygml(std::ostream& of) {
   of << "<cityObjectMember>";
   of << "<tran:Road gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<tran:lod1MultiSurface>";
   of << "<gml:MultiSurface>";
   for (auto& t : _triangles)
@@ -29,10 +29,8 @@
 #include "Separation.h"
 #include "io.h"
 
-float Separation::_heightref = 0.8f;
-
-Separation::Separation(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref)
-  : Boundary3D(wkt, layername, attributes, pid) {
+Separation::Separation(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref)
+  : Boundary3D(p2, layername, attributes, attributerow, pid) {
   _heightref = heightref;
 }
 
@@ -66,7 +64,7 @@ bool Separation::lift() {
 void Separation::get_citygml(std::ostream& of) {
   of << "<cityObjectMember>";
   of << "<gen:GenericCityObject gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<gen:lod1Geometry>";
   of << "<gml:MultiSurface>";
   for (auto& t : _triangles)
@@ -30,8 +30,8 @@
 #include "io.h"
 #include <algorithm>
 
-Terrain::Terrain(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, float innerbuffer)
-  : TIN(wkt, layername, attributes, pid, simplification, innerbuffer) {}
+Terrain::Terrain(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, int simplification, float innerbuffer, double simplification_tinsimp, unsigned long max_points)
+  : TIN(p2, layername, attributes, attributerow, pid, simplification, innerbuffer, simplification_tinsimp, max_points) {}
 
 TopoClass Terrain::get_class() {
   return TERRAIN;
@@ -62,7 +62,7 @@ bool Terrain::lift() {
 void Terrain::get_citygml(std::ostream& of) {
   of << "<cityObjectMember>";
   of << "<luse:LandUse gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<luse:lod1MultiSurface>";
   of << "<gml:MultiSurface>";
   for (auto& t : _triangles)
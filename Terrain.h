@@ -33,7 +33,7 @@
 
 class Terrain: public TIN {
 public:
-  Terrain(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, float innerbuffer);
+  Terrain(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, int simplification, float innerbuffer, double simplification_tinsimp = 0, unsigned long max_points = 0);
   bool        lift();
   bool        add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   void        get_citygml(std::ostream& of);
@@ -28,20 +28,25 @@
 
 #include "TopoFeature.h"
 #include "io.h"
+#include <cstdint>
 
-int TopoFeature::_count = 0;
+//-- two vertices closer than this are the same vertex (also the cell size of the vertex index)
+static const double SNAP_THRESHOLD = 0.001;
+
+static unsigned long long vertex_index_key(long long qx, long long qy) {
+  return ((unsigned long long)qx * 0x9E3779B97F4A7C15ULL) ^ (unsigned long long)qy;
+}
 
 //-----------------------------------------------------------------------------
 
-TopoFeature::TopoFeature(char *wkt, std::string layername, AttributeMap attributes, std::string pid) {
+TopoFeature::TopoFeature(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid) {
   _id = pid;
-  _counter = _count++;
+  _counter = 0;
   _toplevel = true;
   _bVerticalWalls = false;
-  _p2 = new Polygon2();
-  bg::read_wkt(wkt, *_p2);
-  bg::unique(*_p2); //-- remove duplicate vertices
-  bg::correct(*_p2); //-- correct the orientation of the polygons!
+  _bVertexIndex = false;
+  _p2 = p2; //-- the feature owns the polygon, which must be valid (unique vertices, correct orientation)
+  _bbox = Box2(Point2(0, 0), Point2(0, 0));
 
   _adjFeatures = new std::vector<TopoFeature*>;
   _p2z.resize(bg::num_interior_rings(*_p2) + 1);
@@ -53,16 +58,73 @@ TopoFeature::TopoFeature(char *wkt, std::string layername, AttributeMap attribut
     _lidarelevs[i + 1].resize(bg::num_points(_p2->inners()[i]));
   }
   _attributes = attributes;
+  _attributerow = attributerow;
   _layername = layername;
 }
 
 TopoFeature::~TopoFeature() {
-  // TODO: clear memory properly
-  std::clog << "I am dead now.\n";
+  delete _p2;
+  delete _adjFeatures;
+}
+
+//-- the LiDAR elevations collected for each vertex are not used after lifting
+void TopoFeature::release_lifting_data() {
+  std::vector< std::vector< std::vector<int> > >().swap(_lidarelevs);
+}
+
+//-- the adjacent features and the vertex index are not used after the vertical walls
+void TopoFeature::release_adjacency() {
+  std::vector<TopoFeature*>().swap(*_adjFeatures);
+  std::unordered_map< unsigned long long, std::vector< std::pair<int, int> > >().swap(_vertexindex);
+  _bVertexIndex = false;
 }
 
+//-- the elevation samples collected while reading the points (for the snapshot of the map),
+//-- read back into a feature created with the same polygon
+void TopoFeature::write_samples(std::ostream& os) {
+  for (auto& r : _lidarelevs) {
+    for (auto& v : r)
+      write_binary_vector(os, v);
+  }
+}
+
+bool TopoFeature::read_samples(std::istream& is) {
+  for (auto& r : _lidarelevs) {
+    for (auto& v : r) {
+      if (read_binary_vector(is, v) == false)
+        return false;
+    }
+  }
+  return true;
+}
+
+//-- estimate of the heap memory owned by the feature (the object itself excluded)
+std::size_t TopoFeature::get_memory_usage() {
+  std::size_t bytes = 0;
+  bytes += sizeof(Point2) * bg::num_points(*_p2) + sizeof(Ring2) * bg::num_interior_rings(*_p2);
+  for (auto& r : _p2z)
+    bytes += sizeof(std::vector<int>) + sizeof(int) * r.capacity();
+  for (auto& r : _lidarelevs) {
+    bytes += sizeof(std::vector< std::vector<int> >);
+    for (auto& v : r)
+      bytes += sizeof(std::vector<int>) + sizeof(int) * v.capacity();
+  }
+  bytes += sizeof(TopoFeature*) * _adjFeatures->capacity();
+  bytes += sizeof(void*) * _vertexindex.bucket_count();
+  for (auto& v : _vertexindex)
+    bytes += sizeof(v) + sizeof(void*) + sizeof(std::pair<int, int>) * v.second.capacity();
+  bytes += (sizeof(std::pair<Point3, std::string>) + 24) * (_vertices.capacity() + _vertices_vw.capacity());
+  bytes += sizeof(Triangle) * (_triangles.capacity() + _triangles_vw.capacity());
+  return bytes;
+}
+
+//-- the 2D geometry does not change, its envelope is computed once (by Map3d::construct_rtree())
 Box2 TopoFeature::get_bbox2d() {
-  return bg::return_envelope<Box2>(*_p2);
+  return _bbox;
+}
+
+void TopoFeature::compute_bbox2d() {
+  _bbox = bg::return_envelope<Box2>(*_p2);
 }
 
 std::string TopoFeature::get_id() {
@@ -78,10 +140,19 @@ bool TopoFeature::buildCDT() {
   return true;
 }
 
+//-- number of points inserted in the CDT, used to estimate its cost
+unsigned long TopoFeature::get_number_cdt_points() {
+  return bg::num_points(*_p2);
+}
+
 int TopoFeature::get_counter() {
   return _counter;
 }
 
+void TopoFeature::set_counter(int counter) {
+  _counter = counter;
+}
+
 bool TopoFeature::get_top_level() {
   return _toplevel;
 }
@@ -165,10 +236,14 @@ void TopoFeature::get_obj(std::unordered_map< std::string, unsigned long > &dPts
   }
 }
 
-AttributeMap TopoFeature::get_attributes() {
+AttributeTable* TopoFeature::get_attribute_table() {
   return _attributes;
 }
 
+std::size_t TopoFeature::get_attribute_row() {
+  return _attributerow;
+}
+
 void TopoFeature::get_imgeo_object_info(std::ostream& of, std::string id) {
   std::string attribute;
   if (get_attribute("creationDate", attribute)) {
@@ -211,12 +286,13 @@ void TopoFeature::get_imgeo_object_info(std::ostream& of, std::string id) {
   }
 }
 
-void TopoFeature::get_citygml_attributes(std::ostream& of, AttributeMap attributes) {
-  for (auto& attribute : attributes) {
+void TopoFeature::get_citygml_attributes(std::ostream& of) {
+  for (int i = 0; i < _attributes->get_number_fields(); i++) {
+    std::string name = _attributes->get_field_name(i);
     // add attributes except gml_id
-    if (attribute.first.compare("gml_id") != 0) {
+    if (name.compare("gml_id") != 0) {
       std::string type;
-      switch (attribute.second.first) {
+      switch (_attributes->get_field_type(i)) {
       case OFTInteger:
         type = "int";
       case OFTReal:
@@ -226,8 +302,8 @@ void TopoFeature::get_citygml_attributes(std::ostream& of, AttributeMap attribut
       default:
         type = "string";
       }
-      of << "<gen:" + type + "Attribute name=\"" + std::get<0>(attribute) + "\">";
-      of << "<gen:value>" + attribute.second.second + "</gen:value>";
+      of << "<gen:" + type + "Attribute name=\"" + name + "\">";
+      of << "<gen:value>" + _attributes->get_value(_attributerow, i) + "</gen:value>";
       of << "</gen:" + type << "Attribute>";
     }
   }
@@ -281,9 +357,10 @@ bool TopoFeature::get_multipolygon_features(OGRLayer* layer, std::string classNa
     feature->SetField("RoofHeight", z_to_float(height));
   }
   if (writeAttributes) {
-    for (auto attr : _attributes) {
-      if (!(attr.second.first == OFTDateTime && attr.second.second == "0000/00/00 00:00:00")) {
-        feature->SetField(attr.first.c_str(), attr.second.second.c_str());
+    for (int i = 0; i < _attributes->get_number_fields(); i++) {
+      std::string value = _attributes->get_value(_attributerow, i);
+      if (!(_attributes->get_field_type(i) == OFTDateTime && value == "0000/00/00 00:00:00")) {
+        feature->SetField(_attributes->get_field_name(i).c_str(), value.c_str());
       }
     }
     
@@ -395,7 +472,7 @@ void TopoFeature::fix_bowtie() {
   }
 }
 
-void TopoFeature::construct_vertical_walls(NodeColumn& nc, int baseheight) {
+void TopoFeature::construct_vertical_walls(const NodeColumn& nc, int baseheight) {
   //std::clog << this->get_id() << std::endl;
   // if (this->get_id() == "bbdc52a89-00b3-11e6-b420-2bdcc4ab5d7f")
   //   std::clog << "break\n";
@@ -410,8 +487,9 @@ void TopoFeature::construct_vertical_walls(NodeColumn& nc, int baseheight) {
     therings.push_back(iring);
 
   //-- process each vertex of the polygon separately
-  std::vector<int> anc, bnc;
-  std::unordered_map<std::string, std::vector<int>>::const_iterator ncit;
+  //-- anc/bnc point into the (read-only) node column, empty if the vertex has none
+  static const std::vector<int> emptync;
+  NodeColumn::const_iterator ncit;
   Point2 a, b;
   TopoFeature* fadj;
   int ringi = -1;
@@ -434,11 +512,9 @@ void TopoFeature::construct_vertical_walls(NodeColumn& nc, int baseheight) {
       }
       //-- check if there's a nc for either
       ncit = nc.find(gen_key_bucket(&a));
-      if (ncit != nc.end())
-        anc = ncit->second;
+      const std::vector<int>& anc = (ncit != nc.end()) ? ncit->second : emptync;
       ncit = nc.find(gen_key_bucket(&b));
-      if (ncit != nc.end())
-        bnc = ncit->second;
+      const std::vector<int>& bnc = (ncit != nc.end()) ? ncit->second : emptync;
 
       if ((anc.empty() == true) && (bnc.empty() == true))
         continue;
@@ -539,7 +615,6 @@ void TopoFeature::construct_vertical_walls(NodeColumn& nc, int baseheight) {
 }
 
 bool TopoFeature::has_segment(Point2& a, Point2& b, int& aringi, int& api, int& bringi, int& bpi) {
-  double threshold = 0.001;
   std::vector<int> ringis, pis;
   Point2 tmp;
   if (this->has_point2_(a, ringis, pis) == true) {
@@ -547,7 +622,7 @@ bool TopoFeature::has_segment(Point2& a, Point2& b, int& aringi, int& api, int&
       // nextpi = pis[k];
       int nextpi;
       tmp = this->get_next_point2_in_ring(ringis[k], pis[k], nextpi);
-      if (distance(b, tmp) <= threshold) {
+      if (distance(b, tmp) <= SNAP_THRESHOLD) {
         aringi = ringis[k];
         api = pis[k];
         bringi = ringis[k];
@@ -591,51 +666,63 @@ float TopoFeature::get_distance_to_boundaries(Point2& p) {
   return (float)dmin;
 }
 
-bool TopoFeature::has_point2_(const Point2& p, std::vector<int>& ringis, std::vector<int>& pis) {
-  double threshold = 0.001;
-  Ring2 oring = bg::exterior_ring(*_p2);
-  int ringi = 0;
-  bool re = false;
-  for (int i = 0; i < oring.size(); i++) {
-    if (distance(p, oring[i]) <= threshold) {
-      ringis.push_back(ringi);
-      pis.push_back(i);
-      re = true;
-      break;
+//-- hash the vertices on their quantised coordinates, so that has_point2_() does not
+//-- have to scan all the rings. Built lazily, the first time the stitching needs it.
+void TopoFeature::build_vertex_index() {
+  _vertexindex.clear();
+  for (int ringi = 0; ringi <= bg::num_interior_rings(*_p2); ringi++) {
+    const Ring2& ring = get_ring(ringi);
+    for (int i = 0; i < ring.size(); i++) {
+      long long qx = (long long)std::floor(ring[i].x() / SNAP_THRESHOLD);
+      long long qy = (long long)std::floor(ring[i].y() / SNAP_THRESHOLD);
+      _vertexindex[vertex_index_key(qx, qy)].push_back(std::make_pair(ringi, i));
     }
   }
-  ringi++;
-  auto irings = bg::interior_rings(*_p2);
-  for (Ring2& iring : irings) {
-    for (int i = 0; i < iring.size(); i++) {
-      if (distance(p, iring[i]) <= threshold) {
-        ringis.push_back(ringi);
-        pis.push_back(i);
-        re = true;
-        break;
+  _bVertexIndex = true;
+}
+
+//-- returns for each ring the first vertex within SNAP_THRESHOLD of p
+bool TopoFeature::has_point2_(const Point2& p, std::vector<int>& ringis, std::vector<int>& pis) {
+  if (_bVertexIndex == false)
+    build_vertex_index();
+  std::map<int, int> found;
+  long long qx = (long long)std::floor(p.x() / SNAP_THRESHOLD);
+  long long qy = (long long)std::floor(p.y() / SNAP_THRESHOLD);
+  //-- a vertex within the threshold can be in any of the 8 neighbouring cells
+  for (long long dx = -1; dx <= 1; dx++) {
+    for (long long dy = -1; dy <= 1; dy++) {
+      auto it = _vertexindex.find(vertex_index_key(qx + dx, qy + dy));
+      if (it == _vertexindex.end())
+        continue;
+      for (auto& v : it->second) {
+        if (distance(p, get_ring(v.first)[v.second]) <= SNAP_THRESHOLD) {
+          auto f = found.find(v.first);
+          if (f == found.end() || v.second < f->second)
+            found[v.first] = v.second;
+        }
       }
     }
-    ringi++;
   }
-  return re;
+  for (auto& f : found) {
+    ringis.push_back(f.first);
+    pis.push_back(f.second);
+  }
+  return (found.empty() == false);
 }
 
-Point2 TopoFeature::get_point2(int ringi, int pi) {
-  Ring2 ring;
+const Ring2& TopoFeature::get_ring(int ringi) {
   if (ringi == 0)
-    ring = _p2->outer();
+    return _p2->outer();
   else
-    ring = _p2->inners()[ringi - 1];
-  return ring[pi];
+    return _p2->inners()[ringi - 1];
 }
 
-Point2 TopoFeature::get_next_point2_in_ring(int ringi, int i, int& pi) {
-  Ring2 ring;
-  if (ringi == 0)
-    ring = _p2->outer();
-  else
-    ring = _p2->inners()[ringi - 1];
+Point2 TopoFeature::get_point2(int ringi, int pi) {
+  return get_ring(ringi)[pi];
+}
 
+Point2 TopoFeature::get_next_point2_in_ring(int ringi, int i, int& pi) {
+  const Ring2& ring = get_ring(ringi);
   if (i == (ring.size() - 1)) {
     pi = 0;
     return ring.front();
@@ -798,9 +885,9 @@ void TopoFeature::get_triangle_as_gml_triangle(std::ostream& of, Triangle& t, bo
 
 bool TopoFeature::get_attribute(std::string attributeName, std::string &attribute, std::string defaultValue)
 {
-  auto it = _attributes.find(attributeName);
-  if (it != _attributes.end()) {
-    attribute = (*it).second.second;
+  int fieldi = _attributes->find_field(attributeName);
+  if (fieldi != -1) {
+    attribute = _attributes->get_value(_attributerow, fieldi);
     if (!attribute.empty()) {
       // attribute is empty
       return true;
@@ -904,8 +991,8 @@ void TopoFeature::lift_each_boundary_vertices(float percentile) {
 //-------------------------------
 //-------------------------------
 
-Flat::Flat(char *wkt, std::string layername, AttributeMap attributes, std::string pid)
-  : TopoFeature(wkt, layername, attributes, pid) {}
+Flat::Flat(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid)
+  : TopoFeature(p2, layername, attributes, attributerow, pid) {}
 
 int Flat::get_number_vertices() {
   // return int(2 * _vertices.size());
@@ -925,6 +1012,19 @@ int Flat::get_height() {
   return get_vertex_elevation(0, 0);
 }
 
+std::size_t Flat::get_memory_usage() {
+  return TopoFeature::get_memory_usage() + sizeof(int) * _zvaluesinside.capacity();
+}
+
+void Flat::write_samples(std::ostream& os) {
+  TopoFeature::write_samples(os);
+  write_binary_vector(os, _zvaluesinside);
+}
+
+bool Flat::read_samples(std::istream& is) {
+  return TopoFeature::read_samples(is) && read_binary_vector(is, _zvaluesinside);
+}
+
 bool Flat::lift_percentile(float percentile) {
   int z = 0;
   if (_zvaluesinside.empty() == false) {
@@ -940,8 +1040,8 @@ bool Flat::lift_percentile(float percentile) {
 //-------------------------------
 //-------------------------------
 
-Boundary3D::Boundary3D(char *wkt, std::string layername, AttributeMap attributes, std::string pid)
-  : TopoFeature(wkt, layername, attributes, pid) {}
+Boundary3D::Boundary3D(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid)
+  : TopoFeature(p2, layername, attributes, attributerow, pid) {}
 
 int Boundary3D::get_number_vertices() {
   return (int(_vertices.size()) + int(_vertices_vw.size()));
@@ -1000,10 +1100,95 @@ void Boundary3D::smooth_boundary(int passes) {
 //-------------------------------
 //-------------------------------
 
-TIN::TIN(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification, float innerbuffer)
-  : TopoFeature(wkt, layername, attributes, pid) {
+//-- the seed of the sampling of a feature depends only on its id (FNV-1a hash): a feature keeps
+//-- the same points in every run, tile, shard, resumed or incremental run. The draws are taken
+//-- directly from the generator (minstd_rand, whose sequence is fixed by the standard) and not
+//-- with std::uniform_int_distribution, which differs between standard libraries: the points
+//-- kept are the same on every platform.
+static std::uint32_t get_seed(const std::string& id) {
+  std::uint32_t h = 2166136261u;
+  for (unsigned char c : id) {
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+TIN::TIN(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, int simplification, float innerbuffer, double simplification_tinsimp, unsigned long max_points)
+  : TopoFeature(p2, layername, attributes, attributerow, pid), _gen(get_seed(pid)) {
   _simplification = simplification;
+  _simplification_tinsimp = simplification_tinsimp;
   _innerbuffer = innerbuffer;
+  _max_points = max_points;
+  _gridsize = 0;
+  _cellcapacity = 0;
+}
+
+//-- a number in [0, n) drawn from the generator (the modulo bias is negligible for the n used)
+unsigned long TIN::draw(unsigned long n) {
+  return (unsigned long)(_gen() - std::minstd_rand::min()) % n;
+}
+
+//-- the cells hold ~16 points each, at most 64x64 cells. They are only created once the feature
+//-- has received _max_points points, so their cost is bounded by that of the points.
+void TIN::init_reservoirs() {
+  Box2 bbox = bg::return_envelope<Box2>(*_p2);
+  _gridsize = int(std::sqrt(double(_max_points) / 16.0));
+  _gridsize = std::max(1, std::min(64, _gridsize));
+  _cellcapacity = std::max(1UL, _max_points / (unsigned long)(_gridsize * _gridsize));
+  _gridminx = bg::get<bg::min_corner, 0>(bbox);
+  _gridminy = bg::get<bg::min_corner, 1>(bbox);
+  _cellsizex = (bg::get<bg::max_corner, 0>(bbox) - _gridminx) / _gridsize;
+  _cellsizey = (bg::get<bg::max_corner, 1>(bbox) - _gridminy) / _gridsize;
+  _reservoirs.resize(_gridsize * _gridsize);
+  _reservoirseen.assign(_gridsize * _gridsize, 0);
+}
+
+//-- the points are kept as they come until there are _max_points of them; then they are spread
+//-- in the reservoirs, which get the next ones
+void TIN::add_lidar_point(const Point3& p) {
+  if (_max_points == 0 || (_gridsize == 0 && _lidarpts.size() < _max_points)) {
+    _lidarpts.push_back(p);
+    return;
+  }
+  if (_gridsize == 0) {
+    init_reservoirs();
+    for (auto& each : _lidarpts)
+      add_to_reservoir(each);
+    std::vector<Point3>().swap(_lidarpts);
+  }
+  add_to_reservoir(p);
+}
+
+//-- reservoir sampling (algorithm R) per cell: after n points have been offered
+//-- to a cell, each of them is kept with probability capacity/n
+void TIN::add_to_reservoir(const Point3& p) {
+  int cx = (_cellsizex > 0.0) ? int((bg::get<0>(p) - _gridminx) / _cellsizex) : 0;
+  int cy = (_cellsizey > 0.0) ? int((bg::get<1>(p) - _gridminy) / _cellsizey) : 0;
+  cx = std::max(0, std::min(_gridsize - 1, cx));
+  cy = std::max(0, std::min(_gridsize - 1, cy));
+  int c = cy * _gridsize + cx;
+  unsigned long seen = ++_reservoirseen[c];
+  std::vector<Point3>& r = _reservoirs[c];
+  if (r.size() < _cellcapacity)
+    r.push_back(p);
+  else {
+    unsigned long j = draw(seen);
+    if (j < _cellcapacity)
+      r[j] = p;
+  }
+}
+
+void TIN::flush_reservoirs() {
+  std::size_t total = _lidarpts.size();
+  for (auto& r : _reservoirs)
+    total += r.size();
+  _lidarpts.reserve(total);
+  for (auto& r : _reservoirs)
+    _lidarpts.insert(_lidarpts.end(), r.begin(), r.end());
+  std::vector<std::vector<Point3>>().swap(_reservoirs);
+  std::vector<unsigned long>().swap(_reservoirseen);
+  _gridsize = 0;
 }
 
 int TIN::get_number_vertices() {
@@ -1016,21 +1201,53 @@ bool TIN::add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasc
   assign_elevation_to_vertex(p, z, radius);
   if (_simplification <= 1)
     toadd = true;
-  else {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dis(1, _simplification);
-    if (dis(gen) == 1)
-      toadd = true;
-  }
+  else if (draw(_simplification) == 0)
+    toadd = true;
   // Add the point to the lidar points if it is within the polygon and respecting the inner buffer size
   if (toadd && point_in_polygon(p, *(_p2)) && (_innerbuffer == 0.0 || (within_range(p, *(_p2), _innerbuffer) && this->get_distance_to_boundaries(p) > _innerbuffer))) {
-    _lidarpts.push_back(Point3(p.x(), p.y(), z));
+    add_lidar_point(Point3(p.x(), p.y(), z));
   }
   return toadd;
 }
 
 bool TIN::buildCDT() {
-  getCDT(_p2, _p2z, _vertices, _triangles, _lidarpts);
+  flush_reservoirs();
+  getCDT(_p2, _p2z, _vertices, _triangles, _lidarpts, _simplification_tinsimp);
+  std::vector<Point3>().swap(_lidarpts);
   return true;
 }
+
+std::size_t TIN::get_memory_usage() {
+  std::size_t bytes = TopoFeature::get_memory_usage() + sizeof(Point3) * _lidarpts.capacity();
+  for (auto& r : _reservoirs)
+    bytes += sizeof(std::vector<Point3>) + sizeof(Point3) * r.capacity();
+  bytes += sizeof(unsigned long) * _reservoirseen.capacity();
+  return bytes;
+}
+
+//-- the points kept in the reservoirs are written as the other points: a snapshot
+//-- contains the points that were sampled with the settings of the run that wrote it
+void TIN::write_samples(std::ostream& os) {
+  TopoFeature::write_samples(os);
+  std::size_t total = _lidarpts.size();
+  for (auto& r : _reservoirs)
+    total += r.size();
+  write_binary(os, (unsigned long long)total);
+  os.write(reinterpret_cast<const char*>(_lidarpts.data()), sizeof(Point3) * _lidarpts.size());
+  for (auto& r : _reservoirs)
+    os.write(reinterpret_cast<const char*>(r.data()), sizeof(Point3) * r.size());
+}
+
+bool TIN::read_samples(std::istream& is) {
+  std::vector<std::vector<Point3>>().swap(_reservoirs);
+  std::vector<unsigned long>().swap(_reservoirseen);
+  _gridsize = 0;
+  return TopoFeature::read_samples(is) && read_binary_vector(is, _lidarpts);
+}
+
+unsigned long TIN::get_number_cdt_points() {
+  unsigned long n = bg::num_points(*_p2) + _lidarpts.size();
+  for (auto& r : _reservoirs)
+    n += r.size();
+  return n;
+}
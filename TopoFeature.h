@@ -31,15 +31,22 @@
 
 #include "definitions.h"
 #include "geomtools.h"
+#include "AttributeTable.h"
 #include <random>
 
 class TopoFeature {
 public:
-  TopoFeature(char *wkt, std::string layername, AttributeMap attributes, std::string pid);
-  ~TopoFeature();
+  TopoFeature(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid);
+  virtual ~TopoFeature();
 
   virtual bool          lift() = 0;
+  virtual std::size_t   get_memory_usage();
+  virtual void          release_lifting_data();
+  void                  release_adjacency();
+  virtual void          write_samples(std::ostream& os);
+  virtual bool          read_samples(std::istream& is);
   virtual bool          buildCDT();
+  virtual unsigned long get_number_cdt_points();
   virtual bool          add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn) = 0;
   virtual int           get_number_vertices() = 0;
   virtual TopoClass     get_class() = 0;
@@ -50,15 +57,18 @@ public:
   virtual bool          get_shape(OGRLayer*, bool writeAttributes, AttributeMap extraAttributes = AttributeMap()) = 0;
 
   std::string  get_id();
-  void         construct_vertical_walls(NodeColumn& nc, int baseheight);
+  void         construct_vertical_walls(const NodeColumn& nc, int baseheight);
   void         fix_bowtie();
   void         add_adjacent_feature(TopoFeature* adjFeature);
   std::vector<TopoFeature*>* get_adjacent_features();
   int          get_counter();
+  void         set_counter(int counter);
   Polygon2*    get_Polygon2();
   Box2         get_bbox2d();
+  void         compute_bbox2d();
   std::string  get_layername();
   Point2       get_point2(int ringi, int pi);
+  void         build_vertex_index();
   bool         has_point2_(const Point2& p, std::vector<int>& ringis, std::vector<int>& pis);
   bool         has_segment(Point2& a, Point2& b, int& aringi, int& api, int& bringi, int& bpi);
   float        get_distance_to_boundaries(Point2& p);
@@ -71,20 +81,24 @@ public:
   bool         get_top_level();
   bool         get_multipolygon_features(OGRLayer* layer, std::string className, bool writeAttributes, AttributeMap extraAttributes = AttributeMap(), bool writeHeights = false, int height_base = 0, int height = 0);
   void         get_obj(std::unordered_map< std::string, unsigned long > &dPts, std::string mtl, std::string &fs);
-  AttributeMap get_attributes();
+  AttributeTable* get_attribute_table();
+  std::size_t  get_attribute_row();
   void         get_imgeo_object_info(std::ostream& of, std::string id);
-  void         get_citygml_attributes(std::ostream& of, AttributeMap attributes);
+  void         get_citygml_attributes(std::ostream& of);
 protected:
   Polygon2*                         _p2;
+  Box2                              _bbox; //-- envelope of _p2, set by compute_bbox2d()
   std::vector< std::vector<int> >   _p2z;
   std::vector<TopoFeature*>*        _adjFeatures;
   std::string                       _id;
-  int                               _counter;
-  static int                        _count;
+  int                               _counter; //-- set by the Map3d, unique in the map
   bool                              _bVerticalWalls;
   bool                              _toplevel;
   std::string                       _layername;
-  AttributeMap                      _attributes;
+  AttributeTable*                   _attributes; //-- shared by all features of the layer
+  std::size_t                       _attributerow;
+  bool                              _bVertexIndex;
+  std::unordered_map< unsigned long long, std::vector< std::pair<int, int> > > _vertexindex; //-- quantised (x,y) -> (ringi, pi)
 
   std::vector< std::vector< std::vector<int> > > _lidarelevs; //-- used to collect all LiDAR points linked to the polygon
   std::vector< std::pair<Point3, std::string> >   _vertices;
@@ -93,6 +107,7 @@ protected:
   std::vector<Triangle> _triangles_vw;
 
   Point2  get_next_point2_in_ring(int ringi, int i, int& pi);
+  const Ring2& get_ring(int ringi);
   bool    assign_elevation_to_vertex(Point2 &p, double z, float radius);
   double  distance(const Point2 &p1, const Point2 &p2);
   bool    within_range(Point2 &p, Polygon2 &oly, double radius);
@@ -109,7 +124,7 @@ protected:
 
 class Flat: public TopoFeature {
 public:
-  Flat(char *wkt, std::string layername, AttributeMap attributes, std::string pid);
+  Flat(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid);
   int                 get_number_vertices();
   bool                add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   int                 get_height();
@@ -117,16 +132,19 @@ public:
   virtual bool        is_hard() = 0;
   virtual bool        lift() = 0;
   virtual void        get_citygml(std::ostream& of) = 0;
+  void                write_samples(std::ostream& os);
+  bool                read_samples(std::istream& is);
 protected:
   std::vector<int>    _zvaluesinside;
   bool                lift_percentile(float percentile);
+  std::size_t         get_memory_usage();
 };
 
 //---------------------------------------------
 
 class Boundary3D: public TopoFeature {
 public:
-  Boundary3D(char *wkt, std::string layername, AttributeMap attributes, std::string pid);
+  Boundary3D(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid);
   int                  get_number_vertices();
   bool                 add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   virtual TopoClass    get_class() = 0;
@@ -142,7 +160,7 @@ protected:
 
 class TIN: public TopoFeature {
 public:
-  TIN(char *wkt, std::string layername, AttributeMap attributes, std::string pid, int simplification = 0, float innerbuffer = 0);
+  TIN(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, int simplification = 0, float innerbuffer = 0, double simplification_tinsimp = 0, unsigned long max_points = 0);
   int                 get_number_vertices();
   bool                add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   virtual TopoClass   get_class() = 0;
@@ -150,10 +168,28 @@ public:
   virtual bool        lift() = 0;
   virtual void        get_citygml(std::ostream& of) = 0;
   bool                buildCDT();
+  unsigned long       get_number_cdt_points();
+  std::size_t         get_memory_usage();
+  void                write_samples(std::ostream& os);
+  bool                read_samples(std::istream& is);
 protected:
   int                 _simplification;
+  double              _simplification_tinsimp;
   float               _innerbuffer;
   std::vector<Point3> _lidarpts;
+  //-- point budget: grid of reservoirs over the bbox of the polygon
+  unsigned long       _max_points;
+  int                 _gridsize;
+  unsigned long       _cellcapacity;
+  double              _gridminx, _gridminy, _cellsizex, _cellsizey;
+  std::vector<std::vector<Point3>> _reservoirs;
+  std::vector<unsigned long>       _reservoirseen;
+  std::minstd_rand    _gen;
+  unsigned long       draw(unsigned long n);
+  void                init_reservoirs();
+  void                add_lidar_point(const Point3& p);
+  void                add_to_reservoir(const Point3& p);
+  void                flush_reservoirs();
 };
 
 #endif 
@@ -29,10 +29,8 @@
 #include "Water.h"
 #include "io.h"
 
-float Water::_heightref = 0.1;
-
-Water::Water(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref)
-  : Flat(wkt, layername, attributes, pid) {
+Water::Water(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref)
+  : Flat(p2, layername, attributes, attributerow, pid) {
   _heightref = heightref;
 }
 
@@ -66,7 +64,7 @@ bool Water::lift() {
 void Water::get_citygml(std::ostream& of) {
   of << "<cityObjectMember>";
   of << "<wtr:WaterBody gml:id=\"" << this->get_id() << "\">";
-  get_citygml_attributes(of, _attributes);
+  get_citygml_attributes(of);
   of << "<wtr:lod1MultiSurface>";
   of << "<gml:MultiSurface>";
   for (auto& t : _triangles)
@@ -33,7 +33,7 @@
 
 class Water: public Flat {
 public:
-  Water(char *wkt, std::string layername, AttributeMap attributes, std::string pid, float heightref);
+  Water(Polygon2* p2, std::string layername, AttributeTable* attributes, std::size_t attributerow, std::string pid, float heightref);
   bool          lift();
   bool          add_elevation_point(Point2 &p, double z, float radius, LAS14Class lasclass, bool lastreturn);
   void          get_citygml(std::ostream& of);
@@ -43,7 +43,7 @@ public:
   TopoClass     get_class();
   bool          is_hard();
 protected:
-  static float  _heightref;
+  float         _heightref;
 };
 
 #endif /* Water_h */
@@ -0,0 +1,86 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+  
+  Copyright (C) 2015-2017  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux 
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "arena.h"
+#include <cstdint>
+#include <algorithm>
+
+Arena::Arena(std::size_t blocksize) {
+  _blocksize = blocksize;
+  _current = nullptr;
+  _left = 0;
+  _bytesused = 0;
+  _bytesreserved = 0;
+}
+
+Arena::~Arena() {
+  release();
+}
+
+void* Arena::allocate(std::size_t size, std::size_t alignment) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::size_t padding = (alignment - (reinterpret_cast<std::uintptr_t>(_current) % alignment)) % alignment;
+  if (_current == nullptr || padding + size > _left) {
+    //-- objects bigger than a block get a block of their own
+    std::size_t blocksize = std::max(_blocksize, size + alignment);
+    char* block = static_cast<char*>(::operator new(blocksize));
+    _blocks.push_back(block);
+    _bytesreserved += blocksize;
+    _current = block;
+    _left = blocksize;
+    padding = (alignment - (reinterpret_cast<std::uintptr_t>(_current) % alignment)) % alignment;
+  }
+  char* p = _current + padding;
+  _current = p + size;
+  _left -= padding + size;
+  _bytesused += size;
+  return p;
+}
+
+//-- frees all the blocks, in O(number of blocks)
+void Arena::release() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto& block : _blocks)
+    ::operator delete(block);
+  _blocks.clear();
+  _blocks.shrink_to_fit();
+  _current = nullptr;
+  _left = 0;
+  _bytesused = 0;
+  _bytesreserved = 0;
+}
+
+std::size_t Arena::get_bytes_used() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _bytesused;
+}
+
+std::size_t Arena::get_bytes_reserved() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _bytesreserved;
+}
@@ -0,0 +1,67 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+  
+  Copyright (C) 2015-2017  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux 
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef arena_h
+#define arena_h
+
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <utility>
+#include <new>
+
+//-- monotonic allocator: objects are carved out of big blocks and all the blocks are
+//-- freed at once with release(). Destructors are *not* called by the arena, the
+//-- owner of the objects has to do this before release() if they own heap memory.
+class Arena {
+public:
+  explicit Arena(std::size_t blocksize = 1 << 20);
+  ~Arena();
+
+  void*       allocate(std::size_t size, std::size_t alignment);
+  template <typename T, typename... Args>
+  T*          create(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+  void        release();
+  std::size_t get_bytes_used();
+  std::size_t get_bytes_reserved();
+private:
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  std::size_t        _blocksize;
+  std::vector<char*> _blocks;
+  char*              _current;
+  std::size_t        _left;
+  std::size_t        _bytesused;
+  std::size_t        _bytesreserved;
+  std::mutex         _mutex;
+};
+
+#endif /* arena_h */
@@ -0,0 +1,91 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "daemon.h"
+#include <boost/asio.hpp>
+#include <iostream>
+#include <sstream>
+
+bool serve_requests(int port, const RequestHandler& handler) {
+  boost::asio::io_service ioservice;
+  boost::asio::ip::tcp::acceptor acceptor(ioservice);
+  //-- only on the loopback interface: there is no authentication
+  boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), (unsigned short)port);
+  boost::system::error_code ec;
+  acceptor.open(endpoint.protocol(), ec);
+  if (!ec)
+    acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
+  if (!ec)
+    acceptor.bind(endpoint, ec);
+  if (!ec)
+    acceptor.listen(boost::asio::socket_base::max_connections, ec);
+  if (ec) {
+    std::cerr << "ERROR: cannot listen on port " << port << ": " << ec.message() << std::endl;
+    return false;
+  }
+  std::clog << "Waiting for requests on 127.0.0.1:" << port << std::endl;
+  while (true) {
+    boost::asio::ip::tcp::socket socket(ioservice);
+    acceptor.accept(socket, ec);
+    if (ec) {
+      std::cerr << "Warning: cannot accept a connection: " << ec.message() << std::endl;
+      continue;
+    }
+    boost::asio::streambuf buffer(4096); //-- a request is short, a longer line is an error
+    boost::asio::read_until(socket, buffer, '\n', ec);
+    if (ec && ec != boost::asio::error::eof) {
+      std::cerr << "Warning: cannot read the request: " << ec.message() << std::endl;
+      continue;
+    }
+    std::istream is(&buffer);
+    std::string request;
+    std::getline(is, request);
+    if (request.empty() == false && request[request.size() - 1] == '\r')
+      request.erase(request.size() - 1);
+    std::clog << "\nRequest: " << request << std::endl;
+
+    bool stop = (request == "stop");
+    std::ostringstream reply;
+    std::string error;
+    std::string status = "OK\n";
+    if (stop == false && handler(request, reply, error) == false) {
+      status = "ERROR " + error + "\n";
+      reply.str("");
+      std::cerr << "ERROR: " << error << std::endl;
+    }
+    boost::asio::write(socket, boost::asio::buffer(status), ec);
+    if (!ec)
+      boost::asio::write(socket, boost::asio::buffer(reply.str()), ec);
+    if (ec)
+      std::cerr << "Warning: cannot send the reply: " << ec.message() << std::endl;
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    if (stop == true)
+      break;
+  }
+  return true;
+}
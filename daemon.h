@@ -0,0 +1,44 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef daemon_h
+#define daemon_h
+
+#include <string>
+#include <functional>
+#include <ostream>
+
+//-- handles one request: writes the reply to the stream, or returns false with the error
+typedef std::function<bool(const std::string& request, std::ostream& reply, std::string& error)> RequestHandler;
+
+//-- serves requests on a TCP socket on localhost, one at a time (see --daemon): a request is
+//-- one line, the reply is "OK" or "ERROR <message>" on the first line followed by the output,
+//-- then the connection is closed. The request "stop" stops the server.
+bool serve_requests(int port, const RequestHandler& handler);
+
+#endif /* daemon_h */
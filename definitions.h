@@ -49,6 +49,7 @@ typedef struct PolygonFile {
   std::string idfield;
   std::string heightfield;
   bool handle_multiple_heights;
+  bool cache = false;
   std::vector< std::pair<std::string, std::string> > layers;
 } PolygonFile;
 
@@ -33,8 +33,9 @@
 #include <CGAL/Projection_traits_xy_3.h>
 #include <CGAL/Triangulation_vertex_base_with_id_2.h>
 #include <CGAL/Triangulation_face_base_with_info_2.h>
-#include <CGAL/Polygon_2.h>
+#include <CGAL/spatial_sort.h>
 #include <iostream>
+#include <deque>
 
 struct FaceInfo2
 {
@@ -54,7 +55,14 @@ typedef CGAL::Triangulation_data_structure_2<Vb, Fb>				Tds;
 typedef CGAL::Exact_predicates_tag									Itag;
 typedef CGAL::Constrained_Delaunay_triangulation_2<Gt, Tds, Itag>	CDT;
 typedef CDT::Point													Point;
-typedef CGAL::Polygon_2<Gt>											Polygon_2;
+
+//-- polygons up to this size without interior points are triangulated by ear clipping
+static const int EARCLIPPING_MAX_POINTS = 1000;
+static bool _validate_cdt = false;
+
+void set_cdt_validation(bool validate) {
+  _validate_cdt = validate;
+}
 
 bool triangle_contains_segment(Triangle t, int a, int b) {
   if ((t.v0 == a) && (t.v1 == b))
@@ -69,11 +77,11 @@ bool triangle_contains_segment(Triangle t, int a, int b) {
 void mark_domains(CDT& ct,
   CDT::Face_handle start,
   int index,
-  std::list<CDT::Edge>& border) {
+  std::deque<CDT::Edge>& border) {
   if (start->info().nesting_level != -1) {
     return;
   }
-  std::list<CDT::Face_handle> queue;
+  std::deque<CDT::Face_handle> queue;
   queue.push_back(start);
   while (!queue.empty()) {
     CDT::Face_handle fh = queue.front();
@@ -102,7 +110,7 @@ void mark_domains(CDT& cdt) {
   for (CDT::All_faces_iterator it = cdt.all_faces_begin(); it != cdt.all_faces_end(); ++it) {
     it->info().nesting_level = -1;
   }
-  std::list<CDT::Edge> border;
+  std::deque<CDT::Edge> border;
   mark_domains(cdt, cdt.infinite_face(), 0, border);
   while (!border.empty()) {
     CDT::Edge e = border.front();
@@ -114,59 +122,348 @@ void mark_domains(CDT& cdt) {
   }
 }
 
+//-- twice the signed area of triangle oab, > 0 if a left turn (oab is CCW)
+static double cross(const Point2& o, const Point2& a, const Point2& b) {
+  return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+
+static bool same_point(const Point2& a, const Point2& b) {
+  return (a.x() == b.x() && a.y() == b.y());
+}
+
+//-- p inside or on the boundary of the CCW triangle abc
+static bool point_in_triangle(const Point2& a, const Point2& b, const Point2& c, const Point2& p) {
+  return (cross(a, b, p) >= 0 && cross(b, c, p) >= 0 && cross(c, a, p) >= 0);
+}
+
+//-- is m inside the angle formed at position i of the CCW polygon seq
+static bool locally_inside(const std::vector<Point2>& pts, const std::vector<int>& seq, int i, const Point2& m) {
+  int n = int(seq.size());
+  const Point2& p = pts[seq[(i + n - 1) % n]];
+  const Point2& v = pts[seq[i]];
+  const Point2& nx = pts[seq[(i + 1) % n]];
+  if (cross(p, v, nx) >= 0)
+    return (cross(p, v, m) >= 0 && cross(v, nx, m) >= 0);
+  else
+    return (cross(p, v, m) >= 0 || cross(v, nx, m) >= 0);
+}
+
+//-- connect the hole (CW, vertex ids in hole) to the outer sequence (CCW) with a bridge
+//-- from its rightmost vertex, as in Eberly's "Triangulation by Ear Clipping"
+static bool bridge_hole(const std::vector<Point2>& pts, std::vector<int>& seq, const std::vector<int>& hole) {
+  int hm = 0;
+  for (int i = 1; i < hole.size(); i++) {
+    if (pts[hole[i]].x() > pts[hole[hm]].x())
+      hm = i;
+  }
+  const Point2& m = pts[hole[hm]];
+  //-- 1. closest edge hit by the ray from m towards +x
+  int n = int(seq.size());
+  int pi = -1;
+  double xmin = std::numeric_limits<double>::max();
+  for (int i = 0; i < n; i++) {
+    const Point2& a = pts[seq[i]];
+    const Point2& b = pts[seq[(i + 1) % n]];
+    if ((a.y() <= m.y() && m.y() < b.y()) || (b.y() <= m.y() && m.y() < a.y())) {
+      double x = a.x() + (m.y() - a.y()) * (b.x() - a.x()) / (b.y() - a.y());
+      if (x >= m.x() && x < xmin) {
+        xmin = x;
+        pi = (a.x() > b.x()) ? i : (i + 1) % n;
+      }
+    }
+  }
+  if (pi == -1 || xmin == m.x())
+    return false;
+  //-- 2. a reflex vertex inside the triangle (m, i, p) would block the bridge to p:
+  //--    take the one with the smallest angle to the ray instead
+  Point2 ip(xmin, m.y());
+  Point2 p = pts[seq[pi]];
+  Point2 t0 = m, t1 = ip, t2 = p;
+  if (cross(t0, t1, t2) < 0)
+    std::swap(t1, t2);
+  double bestangle = std::numeric_limits<double>::max();
+  double bestdist = std::numeric_limits<double>::max();
+  if (locally_inside(pts, seq, pi, m) == false)
+    pi = -1;
+  else
+    bestangle = std::atan2(std::abs(p.y() - m.y()), p.x() - m.x());
+  for (int i = 0; i < n; i++) {
+    const Point2& r = pts[seq[i]];
+    if (same_point(r, p) && i != pi && pi != -1)
+      continue;
+    if (r.x() < m.x() || point_in_triangle(t0, t1, t2, r) == false)
+      continue;
+    if (same_point(r, p) == false && cross(pts[seq[(i + n - 1) % n]], r, pts[seq[(i + 1) % n]]) > 0)
+      continue; //-- only reflex vertices can be in the way
+    double angle = std::atan2(std::abs(r.y() - m.y()), r.x() - m.x());
+    double dist = (r.x() - m.x()) * (r.x() - m.x()) + (r.y() - m.y()) * (r.y() - m.y());
+    if ((angle < bestangle || (angle == bestangle && dist < bestdist)) && locally_inside(pts, seq, i, m)) {
+      pi = i;
+      bestangle = angle;
+      bestdist = dist;
+    }
+  }
+  if (pi == -1)
+    return false;
+  //-- 3. splice: ..., p, m, hole..., m, p, ...
+  std::vector<int> merged;
+  merged.reserve(seq.size() + hole.size() + 2);
+  merged.insert(merged.end(), seq.begin(), seq.begin() + pi + 1);
+  for (int i = 0; i <= hole.size(); i++)
+    merged.push_back(hole[(hm + i) % hole.size()]);
+  merged.insert(merged.end(), seq.begin() + pi, seq.end());
+  seq.swap(merged);
+  return true;
+}
+
+//-- ear clipping with hole bridging, for polygons without interior points.
+//-- Returns false (and leaves the output untouched) if the polygon is degenerate.
+static bool triangulate_earclipping(const Polygon2* pgn,
+  const std::vector< std::vector<int> > &z,
+  std::vector< std::pair<Point3, std::string> > &vertices,
+  std::vector<Triangle> &triangles) {
+  if (bg::num_points(*pgn) > EARCLIPPING_MAX_POINTS || bg::is_valid(*pgn) == false)
+    return false;
+  //-- all the vertices, outer ring first; Polygon2 is CW with CCW holes
+  std::vector<Point2> pts;
+  std::vector< std::vector<int> > rings;
+  for (int ringi = 0; ringi <= bg::num_interior_rings(*pgn); ringi++) {
+    const Ring2& ring = (ringi == 0) ? pgn->outer() : pgn->inners()[ringi - 1];
+    if (ring.size() < 3)
+      return false;
+    std::vector<int> ids;
+    for (int i = 0; i < ring.size(); i++) {
+      ids.push_back(int(pts.size()));
+      pts.push_back(ring[i]);
+    }
+    std::reverse(ids.begin(), ids.end());
+    rings.push_back(ids);
+  }
+  std::vector<int> seq = rings[0];
+  //-- bridge the holes from right to left, so that a bridge never crosses a hole not yet added
+  std::vector<int> holes;
+  for (int i = 1; i < rings.size(); i++)
+    holes.push_back(i);
+  auto maxx = [&](int r) {
+    double x = -std::numeric_limits<double>::max();
+    for (int id : rings[r])
+      x = std::max(x, pts[id].x());
+    return x;
+  };
+  std::sort(holes.begin(), holes.end(), [&](int a, int b) { return maxx(a) > maxx(b); });
+  for (int h : holes) {
+    if (bridge_hole(pts, seq, rings[h]) == false)
+      return false;
+  }
+  //-- clip the ears
+  int n = int(seq.size());
+  std::vector<int> prev(n), next(n);
+  for (int i = 0; i < n; i++) {
+    prev[i] = (i + n - 1) % n;
+    next[i] = (i + 1) % n;
+  }
+  std::vector<Triangle> tris;
+  tris.reserve(n);
+  int remaining = n;
+  int i = 0;
+  int stall = 0;
+  while (remaining > 3) {
+    const Point2& a = pts[seq[prev[i]]];
+    const Point2& b = pts[seq[i]];
+    const Point2& c = pts[seq[next[i]]];
+    bool ear = (cross(a, b, c) > 0);
+    if (ear == true) {
+      for (int j = next[next[i]]; j != prev[i]; j = next[j]) {
+        const Point2& p = pts[seq[j]];
+        if (same_point(p, a) || same_point(p, b) || same_point(p, c))
+          continue;
+        if (cross(pts[seq[prev[j]]], p, pts[seq[next[j]]]) <= 0 && point_in_triangle(a, b, c, p)) {
+          ear = false;
+          break;
+        }
+      }
+    }
+    if (ear == true) {
+      Triangle t;
+      t.v0 = seq[prev[i]];
+      t.v1 = seq[i];
+      t.v2 = seq[next[i]];
+      tris.push_back(t);
+      next[prev[i]] = next[i];
+      prev[next[i]] = prev[i];
+      i = next[i];
+      remaining--;
+      stall = 0;
+    }
+    else {
+      i = next[i];
+      if (++stall > remaining)
+        return false; //-- no ear left, probably degenerate
+    }
+  }
+  Triangle t;
+  t.v0 = seq[prev[i]];
+  t.v1 = seq[i];
+  t.v2 = seq[next[i]];
+  if (cross(pts[t.v0], pts[t.v1], pts[t.v2]) <= 0)
+    return false;
+  tris.push_back(t);
+
+  int ringi = 0;
+  int id = 0;
+  for (auto& ring : rings) {
+    for (int k = 0; k < ring.size(); k++) {
+      Point3 p = Point3(pts[id].x(), pts[id].y(), z_to_float(z[ringi][k]));
+      vertices.push_back(std::make_pair(p, gen_key_bucket(&p)));
+      id++;
+    }
+    ringi++;
+  }
+  triangles.insert(triangles.end(), tris.begin(), tris.end());
+  return true;
+}
+
+//-- vertical distance between p and the plane of the (finite) face fh
+static double vertical_error(CDT::Face_handle fh, const Point& p) {
+  const Point& a = fh->vertex(0)->point();
+  const Point& b = fh->vertex(1)->point();
+  const Point& c = fh->vertex(2)->point();
+  double det = (b.x() - a.x()) * (c.y() - a.y()) - (c.x() - a.x()) * (b.y() - a.y());
+  if (det == 0.0)
+    return 0.0;
+  double u = ((b.x() - p.x()) * (c.y() - p.y()) - (c.x() - p.x()) * (b.y() - p.y())) / det;
+  double v = ((c.x() - p.x()) * (a.y() - p.y()) - (a.x() - p.x()) * (c.y() - p.y())) / det;
+  double z = u * a.z() + v * b.z() + (1.0 - u - v) * c.z();
+  return std::abs(p.z() - z);
+}
+
+//-- greedy insertion: in each round every remaining point is located in the current TIN
+//-- and, for each triangle, the point with the largest vertical error above the
+//-- threshold is inserted. Stops when all points are within the threshold of the TIN.
+template <class InsertVertex>
+static void greedy_insert(CDT& cdt, std::vector<Point>& pts, double threshold, InsertVertex insert_vertex) {
+  std::vector<std::size_t> remaining(pts.size());
+  for (std::size_t i = 0; i < pts.size(); i++)
+    remaining[i] = i;
+  std::unordered_map< CDT::Face*, std::pair<double, std::size_t> > worst;
+  while (remaining.empty() == false) {
+    worst.clear();
+    std::vector<std::size_t> keep;
+    keep.reserve(remaining.size());
+    CDT::Face_handle hint = CDT::Face_handle();
+    for (std::size_t i : remaining) {
+      CDT::Locate_type lt;
+      int li;
+      CDT::Face_handle fh = cdt.locate(pts[i], lt, li, hint);
+      if (lt == CDT::VERTEX || lt == CDT::OUTSIDE_AFFINE_HULL || cdt.is_infinite(fh))
+        continue; //-- cannot improve the TIN
+      hint = fh;
+      keep.push_back(i);
+      double error = vertical_error(fh, pts[i]);
+      if (error > threshold) {
+        auto it = worst.find(&*fh);
+        if (it == worst.end() || error > it->second.first)
+          worst[&*fh] = std::make_pair(error, i);
+      }
+    }
+    if (worst.empty() == true)
+      break;
+    //-- insert in the order of the points (spatially sorted), not of the hash map
+    std::vector<std::size_t> toinsert;
+    toinsert.reserve(worst.size());
+    for (auto& w : worst)
+      toinsert.push_back(w.second.second);
+    std::sort(toinsert.begin(), toinsert.end());
+    for (std::size_t i : toinsert)
+      insert_vertex(pts[i]);
+    remaining.clear();
+    std::size_t j = 0;
+    for (std::size_t i : keep) {
+      while (j < toinsert.size() && toinsert[j] < i)
+        j++;
+      if (j < toinsert.size() && toinsert[j] == i)
+        continue;
+      remaining.push_back(i);
+    }
+  }
+}
+
 bool getCDT(const Polygon2* pgn,
   const std::vector< std::vector<int> > &z,
   std::vector< std::pair<Point3, std::string> > &vertices,
   std::vector<Triangle> &triangles,
-  const std::vector<Point3> &lidarpts) {
+  const std::vector<Point3> &lidarpts,
+  double tinsimp_threshold) {
+  //-- fast path for the simple polygons without interior points, CGAL for the rest
+  if (lidarpts.empty() && triangulate_earclipping(pgn, z, vertices, triangles))
+    return true;
+
   CDT cdt;
+  //-- the vertices get their id when they are inserted: a new vertex is the one
+  //-- that increases the number of vertices in the CDT. The location starts from the
+  //-- last vertex inserted: its face is taken at each insertion, a face kept from the
+  //-- previous one can be deleted by the constraints inserted since.
+  CDT::Vertex_handle last = CDT::Vertex_handle();
+  auto insert_vertex = [&](const Point& p) {
+    std::size_t before = cdt.number_of_vertices();
+    CDT::Vertex_handle vh = cdt.insert(p, (last == CDT::Vertex_handle()) ? CDT::Face_handle() : last->face());
+    if (cdt.number_of_vertices() > before) {
+      vh->id() = int(vertices.size());
+      Point3 p3 = Point3(p.x(), p.y(), p.z());
+      vertices.push_back(std::make_pair(p3, gen_key_bucket(&p3)));
+    }
+    last = vh;
+    return vh;
+  };
 
-  Ring2 oring = bg::exterior_ring(*pgn);
-  auto irings = bg::interior_rings(*pgn);
+  //-- add the outer and the inner ring(s) as constraints
+  std::vector<CDT::Vertex_handle> ringvertices;
+  for (int ringi = 0; ringi <= bg::num_interior_rings(*pgn); ringi++) {
+    const Ring2& ring = (ringi == 0) ? pgn->outer() : pgn->inners()[ringi - 1];
+    ringvertices.clear();
+    for (int i = 0; i < ring.size(); i++)
+      ringvertices.push_back(insert_vertex(Point(bg::get<0>(ring[i]), bg::get<1>(ring[i]), z_to_float(z[ringi][i]))));
+    for (int i = 0; i < ringvertices.size(); i++) {
+      CDT::Vertex_handle next = ringvertices[(i + 1) % ringvertices.size()];
+      if (ringvertices[i] != next)
+        cdt.insert_constraint(ringvertices[i], next);
+    }
+  }
 
-  Polygon_2 poly;
-  int ringi = 0;
-  //-- add the outer ring as a constraint
-  for (int i = 0; i < oring.size(); i++) {
-    poly.push_back(Point(bg::get<0>(oring[i]), bg::get<1>(oring[i]), z_to_float(z[ringi][i])));
-    //points.push_back(Point(bg::get<0>(oring[i]), bg::get<1>(oring[i])));
-  }
-  cdt.insert_constraint(poly.vertices_begin(), poly.vertices_end(), true);
-  poly.clear();
-  ringi++;
-
-  //-- add the inner ring(s) as a constraint
-  if (irings.size() > 0) {
-    for (auto iring : irings) {
-      for (int i = 0; i < iring.size(); i++) {
-        poly.push_back(Point(bg::get<0>(iring[i]), bg::get<1>(iring[i]), z_to_float(z[ringi][i])));
-      }
-      cdt.insert_constraint(poly.vertices_begin(), poly.vertices_end(), true);
-      poly.clear();
-      ringi++;
+  //-- add the lidar points to the CDT, if any. Sorted along a Hilbert curve, each
+  //-- point is close to the previous one and its location is found in a few steps.
+  if (lidarpts.empty() == false) {
+    std::vector<Point> pts;
+    pts.reserve(lidarpts.size());
+    for (auto &pt : lidarpts)
+      pts.push_back(Point(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt)));
+    CGAL::spatial_sort(pts.begin(), pts.end(), Gt());
+    if (tinsimp_threshold > 0.0)
+      greedy_insert(cdt, pts, tinsimp_threshold, insert_vertex);
+    else {
+      for (auto &pt : pts)
+        insert_vertex(pt);
     }
   }
 
-  //-- add the lidar points to the CDT, if any
-  for (auto &pt : lidarpts) {
-    cdt.insert(Point(bg::get<0>(pt), bg::get<1>(pt), bg::get<2>(pt)));
+  //-- intersecting constraints add vertices of their own: number them all again
+  if (cdt.number_of_vertices() != vertices.size()) {
+    vertices.clear();
+    int index = 0;
+    for (CDT::Finite_vertices_iterator vit = cdt.finite_vertices_begin();
+      vit != cdt.finite_vertices_end(); ++vit) {
+      Point3 p = Point3(vit->point().x(), vit->point().y(), vit->point().z());
+      vertices.push_back(std::make_pair(p, gen_key_bucket(&p)));
+      vit->id() = index++;
+    }
   }
 
   //Mark facets that are inside the domain bounded by the polygon
   mark_domains(cdt);
 
-  unsigned index = 0;
-  int count = 0;
-
-  if (!cdt.is_valid()) {
+  if (_validate_cdt && !cdt.is_valid()) {
     std::clog << "CDT is invalid.\n";
   }
-  for (CDT::Finite_vertices_iterator vit = cdt.finite_vertices_begin();
-    vit != cdt.finite_vertices_end(); ++vit) {
-    Point3 p = Point3(vit->point().x(), vit->point().y(), vit->point().z());
-    vertices.push_back(std::make_pair(p, gen_key_bucket(&p)));
-    vit->id() = index++;
-  }
 
   for (CDT::Finite_faces_iterator fit = cdt.finite_faces_begin();
     fit != cdt.finite_faces_end(); ++fit) {
@@ -176,27 +473,46 @@ bool getCDT(const Polygon2* pgn,
       t.v1 = fit->vertex(1)->id();
       t.v2 = fit->vertex(2)->id();
       triangles.push_back(t);
-      count++;
     }
   }
 
   return true;
 }
 
+//-- copies the (x, y) of the vertices of an OGR ring, without its closing vertex
+static void ogr_to_ring2(OGRLinearRing* ogrring, Ring2& ring) {
+  int n = ogrring->getNumPoints();
+  if (n > 1 && ogrring->getX(0) == ogrring->getX(n - 1) && ogrring->getY(0) == ogrring->getY(n - 1))
+    n--;
+  ring.reserve(n);
+  for (int i = 0; i < n; i++)
+    ring.push_back(Point2(ogrring->getX(i), ogrring->getY(i)));
+}
+
+void ogr_to_polygon2(OGRPolygon* ogrpolygon, Polygon2& p2) {
+  bg::clear(p2);
+  if (ogrpolygon->getExteriorRing() == NULL)
+    return;
+  ogr_to_ring2(ogrpolygon->getExteriorRing(), p2.outer());
+  p2.inners().resize(ogrpolygon->getNumInteriorRings());
+  for (int i = 0; i < ogrpolygon->getNumInteriorRings(); i++)
+    ogr_to_ring2(ogrpolygon->getInteriorRing(i), p2.inners()[i]);
+}
+
 std::string gen_key_bucket(Point2* p) {
-  char* buf = new char[50];
+  char buf[50];
   std::sprintf(buf, "%.3f %.3f", p->get<0>(), p->get<1>());
   return buf;
 }
 
 std::string gen_key_bucket(Point3* p) {
-  char* buf = new char[50];
+  char buf[50];
   std::sprintf(buf, "%.3f %.3f %.3f", p->get<0>(), p->get<1>(), p->get<2>());
   return buf;
 }
 
 std::string gen_key_bucket(Point3* p, int z) {
-  char* buf = new char[50];
+  char buf[50];
   std::sprintf(buf, "%.3f %.3f %d", p->get<0>(), p->get<1>(), z);
   return buf;
 }
@@ -32,15 +32,18 @@
 #include "definitions.h"
 #include <random>
 
+void ogr_to_polygon2(OGRPolygon* ogrpolygon, Polygon2& p2);
 std::string gen_key_bucket(Point2* p);
 std::string gen_key_bucket(Point3* p);
 std::string gen_key_bucket(Point3* p, int z);
 
 bool triangle_contains_segment(Triangle t, int a, int b);
+void set_cdt_validation(bool validate);
 bool getCDT(const Polygon2* pgn,
             const std::vector< std::vector<int> > &z, 
             std::vector< std::pair<Point3, std::string> > &vertices, 
             std::vector<Triangle> &triangles, 
-            const std::vector<Point3> &lidarpts = std::vector<Point3>());
+            const std::vector<Point3> &lidarpts = std::vector<Point3>(),
+            double tinsimp_threshold = 0.0);
 
 #endif /* geomtools_h */
@@ -27,6 +27,17 @@
 */
 
 #include "io.h"
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#if defined(_WIN32)
+  #include <windows.h>
+  #include <psapi.h>
+  #pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+  #include <sys/resource.h>
+  #include <mach/mach.h>
+#endif
 
 void printProgressBar(int percent) {
   std::string bar;
@@ -177,3 +188,134 @@ std::vector<std::string> stringsplit(std::string str, char delimiter) {
 
   return internal;
 }
+
+void write_binary_string(std::ostream& os, const std::string& s) {
+  write_binary(os, (unsigned long long)s.size());
+  os.write(s.data(), s.size());
+}
+
+bool read_binary_string(std::istream& is, std::string& s) {
+  unsigned long long size;
+  if (read_binary(is, size) == false || size > (1ULL << 32))
+    return false;
+  s.resize(size);
+  if (size > 0)
+    is.read(&s[0], size);
+  return bool(is);
+}
+
+#if defined(__linux__)
+//-- value in kB of a field (eg "VmRSS:") of /proc/self/status
+static std::size_t read_proc_status(const std::string& field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size(), field) == 0)
+      return std::stoul(line.substr(field.size()));
+  }
+  return 0;
+}
+#endif
+
+//-- resident set size of the process in kB, 0 if unknown
+std::size_t get_current_rss() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.WorkingSetSize / 1024;
+  return 0;
+#elif defined(__APPLE__)
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+    return info.resident_size / 1024;
+  return 0;
+#elif defined(__linux__)
+  return read_proc_status("VmRSS:");
+#else
+  return 0;
+#endif
+}
+
+//-- peak resident set size in kB since the last reset_peak_rss() (since the start
+//-- of the process where the peak cannot be reset), 0 if unknown
+std::size_t get_peak_rss() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize / 1024;
+  return 0;
+#elif defined(__APPLE__)
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024; //-- in bytes on macOS
+#elif defined(__linux__)
+  return read_proc_status("VmHWM:");
+#else
+  return 0;
+#endif
+}
+
+void reset_peak_rss() {
+#if defined(__linux__)
+  //-- "5" resets the high water mark to the current RSS (Linux >= 4.0)
+  std::ofstream clearrefs("/proc/self/clear_refs");
+  clearrefs << "5";
+#endif
+}
+
+//-- with several chunks in memory their stages overlap: the peak is then that of the process
+static std::atomic<bool> _peakperstage(true);
+
+void set_memory_peak_per_stage(bool perstage) {
+  _peakperstage = perstage;
+}
+
+//-- logs the memory used by the stage that just finished, and starts a new one
+void print_memory_stage(std::string stage) {
+  if (_peakperstage == true) {
+    std::clog << "\tMemory after " << stage << ": " << get_current_rss() / 1024 << " MB (peak during stage: " << get_peak_rss() / 1024 << " MB)\n";
+    reset_peak_rss();
+  }
+  else
+    std::clog << "\tMemory after " << stage << ": " << get_current_rss() / 1024 << " MB (process-wide peak: " << get_peak_rss() / 1024 << " MB)\n";
+}
+
+//-- the characters of each thread are kept until the end of the line, which is then written
+//-- with the prefix of the thread while the others wait
+class LineSyncBuf : public std::streambuf {
+public:
+  LineSyncBuf(std::streambuf* out) : _out(out) {}
+  static thread_local std::string prefix;
+protected:
+  int overflow(int c) {
+    if (c == traits_type::eof())
+      return traits_type::not_eof(c);
+    _line += char(c);
+    if (c == '\n') {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _out->sputn(prefix.data(), prefix.size());
+      _out->sputn(_line.data(), _line.size());
+      _out->pubsync();
+      _line.clear();
+    }
+    return c;
+  }
+private:
+  std::streambuf* _out;
+  std::mutex      _mutex;
+  static thread_local std::string _line;
+};
+
+thread_local std::string LineSyncBuf::prefix;
+thread_local std::string LineSyncBuf::_line;
+
+void set_log_per_line(bool perline) {
+  static std::streambuf* original = std::clog.rdbuf();
+  static LineSyncBuf buf(original);
+  std::clog.rdbuf(perline ? &buf : original);
+}
+
+void set_log_prefix(std::string prefix) {
+  LineSyncBuf::prefix = prefix;
+}
@@ -45,4 +45,54 @@ bool  is_string_integer(std::string s, int min = 0, int max = 1e6);
 float z_to_float(int z);
 std::vector<std::string> stringsplit(std::string str, char delimiter);
 
+//-- binary I/O (native byte order), used for the polygon cache
+template <typename T>
+void write_binary(std::ostream& os, const T& value) {
+  os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+template <typename T>
+bool read_binary(std::istream& is, T& value) {
+  is.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return bool(is);
+}
+void write_binary_string(std::ostream& os, const std::string& s);
+bool read_binary_string(std::istream& is, std::string& s);
+//-- for vectors of plain values (int, Point3...), written in one block
+template <typename T>
+void write_binary_vector(std::ostream& os, const std::vector<T>& v) {
+  write_binary(os, (unsigned long long)v.size());
+  if (v.empty() == false)
+    os.write(reinterpret_cast<const char*>(v.data()), sizeof(T) * v.size());
+}
+template <typename T>
+bool read_binary_vector(std::istream& is, std::vector<T>& v) {
+  unsigned long long size;
+  if (read_binary(is, size) == false || size > (1ULL << 32))
+    return false;
+  v.resize(size);
+  if (size > 0)
+    is.read(reinterpret_cast<char*>(v.data()), sizeof(T) * size);
+  return bool(is);
+}
+
+//-- to read a memory-mapped file with the functions above
+class MemoryStreamBuf : public std::streambuf {
+public:
+  MemoryStreamBuf(const char* begin, std::size_t size) {
+    char* b = const_cast<char*>(begin);
+    setg(b, b, b + size);
+  }
+};
+
+std::size_t get_current_rss();
+std::size_t get_peak_rss();
+void        reset_peak_rss();
+void        print_memory_stage(std::string stage);
+void        set_memory_peak_per_stage(bool perstage);
+
+//-- std::clog shared by threads working on different chunks: each line is written at once,
+//-- after the prefix of its thread
+void        set_log_per_line(bool perline);
+void        set_log_prefix(std::string prefix);
+
 #endif
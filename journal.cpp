@@ -0,0 +1,95 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "journal.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+Journal::Journal() {}
+
+//-- without resume the journal is started again; with resume the entries of the previous run
+//-- are read, a last line without its newline (written when the run died) is ignored
+bool Journal::open(std::string filename, bool resume) {
+  _filename = filename;
+  _entries.clear();
+  if (resume == true) {
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (ifs.is_open() == true) {
+      std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+      std::size_t start = 0;
+      std::size_t end;
+      while ((end = content.find('\n', start)) != std::string::npos) {
+        _entries.insert(content.substr(start, end - start));
+        start = end + 1;
+      }
+      //-- rewrite the complete lines only, so that the next entries are appended after them
+      std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+      ofs << content.substr(0, start);
+      return bool(ofs);
+    }
+  }
+  std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (ofs.is_open() == false) {
+    std::cerr << "ERROR: cannot write the journal " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Journal::has(std::string entry) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return (_entries.count(entry) > 0);
+}
+
+//-- a journal that was not opened (daemon) keeps its entries in memory only
+bool Journal::add(std::string entry) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_filename.empty() == true) {
+    _entries.insert(entry);
+    return true;
+  }
+  std::ofstream ofs(_filename.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+  ofs << entry << "\n";
+  ofs.close();
+  if (ofs.fail() == true) {
+    std::cerr << "ERROR: cannot write to the journal " << _filename << std::endl;
+    return false;
+  }
+  _entries.insert(entry);
+  return true;
+}
+
+bool Journal::empty() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _entries.empty();
+}
+
+std::string Journal::get_filename() {
+  return _filename;
+}
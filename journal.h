@@ -0,0 +1,54 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef journal_h
+#define journal_h
+
+#include <string>
+#include <set>
+#include <mutex>
+
+//-- records the chunks of work that are finished (one line each, appended and flushed as
+//-- soon as the chunk is done) so that an interrupted run can be resumed with --resume;
+//-- the chunks done in parallel (see TaskGraph) add their entries from several threads
+class Journal {
+public:
+  Journal();
+
+  bool        open(std::string filename, bool resume);
+  bool        has(std::string entry);
+  bool        add(std::string entry);
+  bool        empty();
+  std::string get_filename();
+private:
+  std::string           _filename;
+  std::set<std::string> _entries;
+  std::mutex            _mutex;
+};
+
+#endif /* journal_h */
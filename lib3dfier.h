@@ -0,0 +1,48 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef lib3dfier_h
+#define lib3dfier_h
+
+//-- the header of lib3dfier, to embed 3dfier in another program. A map is used like this:
+//--   Map3d map3d;
+//--   map3d.set_...(); (the options of the config file)
+//--   map3d.add_polygon(...); for each polygon (or add_polygons_files())
+//--   map3d.construct_rtree();
+//--   map3d.add_elevation_points(block); for each block of points (or add_las_file())
+//--   map3d.set_feature_callback([](TopoFeature* f) { ... });
+//--   map3d.threeDfy();
+//--   map3d.construct_CDT(); (the callback is called for each feature when it is finished)
+//--   map3d.clear_features();
+//-- Each map has its own features and settings, several maps can be used in one process.
+
+#include "definitions.h"
+#include "Map3d.h"
+#include "io.h"
+
+#endif /* lib3dfier_h */
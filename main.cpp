@@ -27,7 +27,6 @@
 */
 
 //-- TODO: create the topo DS locally? to prevent cases where nodes on only in one polygon. Or pprepair before?
-//-- TODO: write output all polygons once the tile completely containing is closed?
 //-- TODO : how to make roads horizontal "in the width"? 
 
 //-----------------------------------------------------------------------------
@@ -37,13 +36,56 @@
 #include "io.h"
 #include "TopoFeature.h"
 #include "Map3d.h"
+#include "merge.h"
+#include "journal.h"
+#include "daemon.h"
+#include "taskgraph.h"
+#include "threadpool.h"
 #include "boost/locale.hpp"
 #include "boost/chrono.hpp"
 
 std::string VERSION = "0.9.8";
 
+//-- a piece of the work: the whole dataset, or one tile
+typedef struct Chunk {
+  std::string name;  //-- in the journal: empty for the whole dataset, " col row" for a tile
+  std::vector<std::string> ofnames; //-- one per output
+  std::string snapshot;
+  bool        tiled = false;
+  Box2        tile;
+} Chunk;
+
+//-- an output of the run: its format, its file (or prefix, or database) and its writing options
+typedef struct Output {
+  std::string format;
+  std::string path;
+  YAML::Node  options;
+} Output;
+
+//-- what the output format needs, see plan_stages()
+typedef struct StagePlan {
+  std::set<std::string> classes; //-- the lifting classes read, empty for all
+  bool                  lift = true;
+  bool                  stitch = true;
+  bool                  cdt = true;
+  bool                  samples = false; //-- written from the samples of the points, before lifting
+} StagePlan;
+
 bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures);
 int main(int argc, const char * argv[]);
+void set_map3d_options(Map3d& map3d, YAML::Node nodes, bool verbose = true);
+bool read_polygons_and_points(Map3d& map3d, std::vector<PolygonFile>& polygonFiles, std::vector<PointFile>& pointFiles, std::string snapshot, bool bIncremental, bool tiled, Journal& journal, std::string chunk);
+std::vector<Output> get_outputs(YAML::Node n, std::string ofname);
+bool has_building_floor(const Output& output);
+StagePlan plan_stages(std::string format, bool bStitching);
+StagePlan plan_outputs(const std::vector<Output>& outputs, bool bStitching);
+void remove_unneeded_layers(std::vector<PolygonFile>& polygonFiles, const StagePlan& plan);
+void lift_features(Map3d& map3d, const StagePlan& plan);
+bool is_stream_format(std::string format);
+bool write_output(Map3d& map3d, YAML::Node n, std::string format, std::string ofname, std::ostream& of);
+bool write_features(Map3d& map3d, YAML::Node n, std::string format, std::string ofname);
+bool threedfy_chunks(std::vector<Chunk>& chunks, YAML::Node nodes, std::vector<Output>& outputs, std::vector<PolygonFile>& polygonFiles, std::vector<PointFile>& pointFiles, bool bIncremental, bool bStitching, double tileHalo, Journal& journal);
+bool run_daemon(Map3d& map3d, Map3d& request, std::vector<PolygonFile>& polygonFiles, std::vector<PointFile>& pointFiles, const Output& output, std::string snapshot, bool bStitching, double tileHalo, int port);
 void print_license();
 
 int main(int argc, const char * argv[]) {
@@ -60,6 +102,11 @@ int main(int argc, const char * argv[]) {
     "under certain conditions; for details run 3dfier with the '--license' option.\n";
 
   std::string ofname;
+  int shard = 0;
+  int numberOfShards = 1;
+  bool merge = false;
+  bool resume = false;
+  int daemonPort = 0;
 
   //-- reading the config file
   if (argc == 2) {
@@ -76,16 +123,49 @@ int main(int argc, const char * argv[]) {
     }
     else {
       std::clog << licensewarning << std::endl;
-      std::cerr << "Usage: 3dfier config.yml -o output.ext\n";
+      std::cerr << "Usage: 3dfier config.yml -o output.ext [--shard i/N] [--resume] | [--merge]\n";
+      std::cerr << "       3dfier config.yml --daemon port\n";
       return 0;
     }
   }
-  else if (argc == 4 && (std::string)argv[2] == "-o" && boost::filesystem::path(argv[1]).extension() == ".yml") {
+  else if (argc >= 4 && (std::string)argv[2] == "-o" && boost::filesystem::path(argv[1]).extension() == ".yml") {
     ofname = argv[3];
+    //-- "--shard i/N": this process handles the tiles i, i+N, i+2N...; "--merge": combines the outputs of the tiles;
+    //-- "--resume": continues an interrupted run, the chunks in its journal are not done again
+    for (int i = 4; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--shard" && i + 1 < argc) {
+        std::vector<std::string> shardsplit = stringsplit(argv[++i], '/');
+        if (shardsplit.size() != 2 || is_string_integer(shardsplit[1], 1, 1000000) == false || is_string_integer(shardsplit[0], 0, std::stoi(shardsplit[1]) - 1) == false) {
+          std::cerr << "ERROR: invalid shard '" << argv[i] << "', must be i/N with 0 <= i < N.\n";
+          return 0;
+        }
+        shard = std::stoi(shardsplit[0]);
+        numberOfShards = std::stoi(shardsplit[1]);
+      }
+      else if (arg == "--merge")
+        merge = true;
+      else if (arg == "--resume")
+        resume = true;
+      else {
+        std::clog << licensewarning << std::endl;
+        std::cerr << "Usage: 3dfier config.yml -o output.ext [--shard i/N] [--resume] | [--merge]\n";
+        return 0;
+      }
+    }
+  }
+  //-- "--daemon port": reads the inputs once and 3dfies the extents requested on the port
+  else if (argc == 4 && (std::string)argv[2] == "--daemon" && boost::filesystem::path(argv[1]).extension() == ".yml") {
+    if (is_string_integer(argv[3], 1, 65535) == false) {
+      std::cerr << "ERROR: invalid port '" << argv[3] << "', must be between 1 and 65535.\n";
+      return 0;
+    }
+    daemonPort = std::stoi(argv[3]);
   }
   else {
     std::clog << licensewarning << std::endl;
-    std::cerr << "Usage: 3dfier config.yml -o output.ext\n";
+    std::cerr << "Usage: 3dfier config.yml -o output.ext [--shard i/N] [--resume] | [--merge]\n";
+    std::cerr << "       3dfier config.yml --daemon port\n";
     return 0;
   }
 
@@ -109,106 +189,36 @@ int main(int argc, const char * argv[]) {
   }
   std::clog << "Config file is valid.\n";
 
-  Map3d map3d;
   YAML::Node nodes = YAML::LoadFile(argv[1]);
-  //-- store the lifting options in the Map3d
-  YAML::Node n = nodes["lifting_options"];
-  if (n["Building"]) {
-    if (n["Building"]["height_roof"]) {
-      std::string height = n["Building"]["height_roof"].as<std::string>();
-      map3d.set_building_heightref_roof(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-    }
-    if (n["Building"]["height_floor"]) {
-      std::string height = n["Building"]["height_floor"].as<std::string>();
-      map3d.set_building_heightref_floor(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-    }
-    if (n["Building"]["lod"]) {
-      map3d.set_building_lod(n["Building"]["lod"].as<int>());
-    }
-    if (n["Building"]["triangulate"]) {
-      if (n["Building"]["triangulate"].as<std::string>() == "true")
-        map3d.set_building_triangulate(true);
-      else
-        map3d.set_building_triangulate(false);
-    }
-  }
-  if (n["Terrain"]) {
-    if (n["Terrain"]["simplification"])
-      map3d.set_terrain_simplification(n["Terrain"]["simplification"].as<int>());
-    if (n["Terrain"]["innerbuffer"])
-      map3d.set_terrain_innerbuffer(n["Terrain"]["innerbuffer"].as<float>());
-  }
-  if (n["Forest"]) {
-    if (n["Forest"]["simplification"])
-      map3d.set_forest_simplification(n["Forest"]["simplification"].as<int>());
-    if (n["Forest"]["innerbuffer"])
-      map3d.set_forest_innerbuffer(n["Forest"]["innerbuffer"].as<float>());
-    if (n["Forest"]["ground_points_only"] && n["Forest"]["ground_points_only"].as<std::string>() == "true")
-      map3d.set_forest_ground_points_only(true);
-  }
-  if (n["Water"]) {
-    if (n["Water"]["height"]) {
-      std::string height = n["Water"]["height"].as<std::string>();
-      map3d.set_water_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-    }
-  }
-  if (n["Road"]) {
-    if (n["Road"]["height"]) {
-      std::string height = n["Road"]["height"].as<std::string>();
-      map3d.set_road_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
-    }
-  }
-  if (n["Separation"]) {
-    if (n["Separation"]["height"]) {
-      std::string height = n["Separation"]["height"].as<std::string>();
-      map3d.set_separation_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+  std::vector<Output> outputs = get_outputs(nodes["output"], ofname);
+  //-- the shards are tiles, written to one file per tile
+  for (auto& output : outputs) {
+    if (numberOfShards > 1 && (output.format == "PostGIS" || output.format == "PostGIS-Multi" || output.format == "PostGIS-PDOK")) {
+      std::cerr << "ERROR: --shard cannot be used with output format " << output.format << ". Aborting.\n";
+      return 0;
     }
   }
-  if (n["Bridge/Overpass"]) {
-    if (n["Bridge/Overpass"]["height"]) {
-      std::string height = n["Bridge/Overpass"]["height"].as<std::string>();
-      map3d.set_bridge_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+
+  if (merge == true) {
+    for (auto& output : outputs) {
+      std::string gdaldriver = output.options["gdal_driver"] ? output.options["gdal_driver"].as<std::string>() : "";
+      if (merge_tile_outputs(output.format, output.path, gdaldriver) == false) {
+        std::cerr << "ERROR: Merging the tiles failed. Aborting.\n";
+        return 0;
+      }
     }
+    std::clog << "Successfully merged.\n";
+    return 1;
   }
 
-  n = nodes["options"];
+  Map3d map3d;
+  set_map3d_options(map3d, nodes);
+  YAML::Node n = nodes["options"];
   bool bStitching = true;
-  if (n["radius_vertex_elevation"])
-    map3d.set_radius_vertex_elevation(n["radius_vertex_elevation"].as<float>());
-  if (n["building_radius_vertex_elevation"])
-    map3d.set_building_radius_vertex_elevation(n["building_radius_vertex_elevation"].as<float>());
-  if (n["threshold_jump_edges"])
-    map3d.set_threshold_jump_edges(n["threshold_jump_edges"].as<float>());
-  if (n["use_vertical_walls"] && n["use_vertical_walls"].as<std::string>() == "true")
-    map3d.set_use_vertical_walls(true);
   if (n["stitching"]) {
     if (n["stitching"].as<std::string>() == "false")
       bStitching = false;
   }
-  if (n["extent"]) {
-    std::vector<std::string> extent_split = stringsplit(n["extent"].as<std::string>(), ',');
-    double xmin, xmax, ymin, ymax;
-    bool wentgood = true;
-    try {
-      (n["radius_vertex_elevation"].as<std::string>());
-      xmin = boost::lexical_cast<double>(extent_split[0]);
-      ymin = boost::lexical_cast<double>(extent_split[1]);
-      xmax = boost::lexical_cast<double>(extent_split[2]);
-      ymax = boost::lexical_cast<double>(extent_split[3]);
-    }
-    catch (boost::bad_lexical_cast& e) {
-      wentgood = false;
-    }
-
-    if (!wentgood || xmin > xmax || ymin > ymax || boost::geometry::area(Box2(Point2(xmin, ymin), Point2(xmax, ymax))) <= 0.0) {
-      std::cerr << "ERROR: The supplied extent is not valid: (" << n["extent"].as<std::string>() << "), using all polygons\n";
-    }
-    else
-    {
-      std::clog << "Using extent for polygons: (" << n["extent"].as<std::string>() << ")\n";
-      map3d.set_requested_extent(xmin, ymin, xmax, ymax);
-    }
-  }
 
   //-- add the polygons to the map3d
   std::vector<PolygonFile> polygonFiles;
@@ -229,6 +239,11 @@ int main(int argc, const char * argv[]) {
     if ((*it)["handle_multiple_heights"] && (*it)["handle_multiple_heights"].as<std::string>() == "true") {
       handle_multiple_heights = true;
     }
+    // Get the cache setting
+    bool cache = false;
+    if ((*it)["cache"] && (*it)["cache"].as<std::string>() == "true") {
+      cache = true;
+    }
 
     // Get all datasets
     YAML::Node datasets = (*it)["datasets"];
@@ -238,6 +253,7 @@ int main(int argc, const char * argv[]) {
       file.idfield = uniqueid;
       file.heightfield = heightfield;
       file.handle_multiple_heights = handle_multiple_heights;
+      file.cache = cache;
       if ((*it)["lifting"]) {
         file.layers.emplace_back(std::string(), (*it)["lifting"].as<std::string>());
         polygonFiles.push_back(file);
@@ -252,25 +268,6 @@ int main(int argc, const char * argv[]) {
     }
   }
 
-  bool added = map3d.add_polygons_files(polygonFiles);
-  if (!added) {
-    std::cerr << "ERROR: Missing polygon data, cannot 3dfy the dataset. Aborting.\n";
-    return 0;
-  }
-  std::clog << "\nTotal # of polygons: " << boost::locale::as::number << map3d.get_num_polygons() << std::endl;
-
-  //-- spatially index the polygons
-  map3d.construct_rtree();
-
-  //-- print bbox from _rtree
-  Box2 b = map3d.get_bbox();
-  std::clog << std::setprecision(3) << std::fixed;
-  std::clog << "Spatial extent: ("
-    << bg::get<bg::min_corner, 0>(b) << ", "
-    << bg::get<bg::min_corner, 1>(b) << ") ("
-    << bg::get<bg::max_corner, 0>(b) << ", "
-    << bg::get<bg::max_corner, 1>(b) << ")\n";
-  
   int threadPoolSize = 4;
   std::vector<PointFile> fileList;
 
@@ -323,9 +320,182 @@ int main(int argc, const char * argv[]) {
       }
     }
   }
+
+  //-- process everything at once, or tile by tile so that the memory depends on the size of the tiles
+  n = nodes["options"];
+  double tileSize = 0.0;
+  double tileHalo = 0.0;
+  if (n["tile_size"])
+    tileSize = n["tile_size"].as<double>();
+  if (n["tile_halo"])
+    tileHalo = n["tile_halo"].as<double>();
+  std::string snapshot;
+  if (n["snapshot"])
+    snapshot = n["snapshot"].as<std::string>();
+  bool bIncremental = false;
+  if (n["incremental"] && n["incremental"].as<std::string>() == "true")
+    bIncremental = true;
+
+  if (daemonPort > 0) {
+    Map3d request;
+    set_map3d_options(request, nodes);
+    if (run_daemon(map3d, request, polygonFiles, fileList, outputs.front(), snapshot, bStitching, tileHalo, daemonPort) == false)
+      return 0;
+    std::clog << "Daemon stopped.\n";
+    return 1;
+  }
+
+  //-- the daemon reads all the classes, the format of each request is different
+  remove_unneeded_layers(polygonFiles, plan_outputs(outputs, bStitching));
+  if (polygonFiles.empty() == true)
+    std::clog << "Warning: no input polygons of the classes needed for the output.\n";
+
+  //-- the chunks done are journaled (per shard); with --resume those of the previous run are skipped
+  Journal journal;
+  std::string journalname = ofname + ((numberOfShards > 1) ? ".shard" + std::to_string(shard) : "") + ".journal";
+  if (journal.open(journalname, resume) == false)
+    return 0;
+  if (resume == true)
+    std::clog << "Resuming from the journal " << journalname << std::endl;
+
+  //-- the chunks to do: the whole dataset, or the tiles of this shard not done yet
+  std::vector<Chunk> chunks;
+  if (tileSize <= 0.0 && numberOfShards == 1) {
+    if (journal.has("output") == true)
+      std::clog << "Output already written according to the journal, nothing to do.\n";
+    else {
+      Chunk chunk;
+      for (auto& output : outputs)
+        chunk.ofnames.push_back(output.path);
+      chunk.snapshot = snapshot;
+      chunks.push_back(chunk);
+    }
+  }
+  else {
+    //-- the extent of each tile is different, a cache would be rewritten for each of them
+    for (auto& file : polygonFiles) {
+      if (file.cache == true)
+        std::clog << "Warning: cache of the polygons not used when processing by tiles (" << file.filename << ")\n";
+      file.cache = false;
+    }
+    Box2 extent;
+    if (map3d.get_polygons_extent(polygonFiles, extent) == false) {
+      std::cerr << "ERROR: Missing polygon data, cannot 3dfy the dataset. Aborting.\n";
+      return 0;
+    }
+    //-- one more tile than needed so that the maximum is strictly inside the last tile (tiles are half-open)
+    double minx = bg::get<bg::min_corner, 0>(extent);
+    double miny = bg::get<bg::min_corner, 1>(extent);
+    if (tileSize <= 0.0)
+      tileSize = std::max(bg::get<bg::max_corner, 0>(extent) - minx, bg::get<bg::max_corner, 1>(extent) - miny) / numberOfShards;
+    int ncols = int((bg::get<bg::max_corner, 0>(extent) - minx) / tileSize) + 1;
+    int nrows = int((bg::get<bg::max_corner, 1>(extent) - miny) / tileSize) + 1;
+    std::clog << "Processing by tiles: " << ncols << "x" << nrows << " tiles of " << tileSize << "m\n";
+    //-- a journal is only valid for the same tiles
+    std::ostringstream tiling;
+    tiling << std::setprecision(17) << "tiles " << ncols << " " << nrows << " " << tileSize << " " << minx << " " << miny;
+    if (journal.empty() == false && journal.has(tiling.str()) == false) {
+      std::cerr << "ERROR: the journal " << journalname << " was written for other tiles, remove it to start again. Aborting.\n";
+      return 0;
+    }
+    if (journal.has(tiling.str()) == false && journal.add(tiling.str()) == false)
+      return 0;
+    if (numberOfShards > 1)
+      std::clog << "Shard " << shard << "/" << numberOfShards << ": every " << numberOfShards << "th tile from tile " << shard << std::endl;
+    for (int row = 0; row < nrows; row++) {
+      for (int col = 0; col < ncols; col++) {
+        if ((row * ncols + col) % numberOfShards != shard)
+          continue;
+        Chunk chunk;
+        chunk.name = " " + std::to_string(col) + " " + std::to_string(row);
+        if (journal.has("output" + chunk.name) == true) {
+          std::clog << "Tile " << col << "-" << row << " already written according to the journal, skipping it.\n";
+          continue;
+        }
+        for (auto& output : outputs)
+          chunk.ofnames.push_back(get_tile_filename(output.path, col, row));
+        chunk.snapshot = snapshot.empty() ? snapshot : get_tile_filename(snapshot, col, row);
+        chunk.tiled = true;
+        chunk.tile = Box2(Point2(minx + col * tileSize, miny + row * tileSize), Point2(minx + (col + 1) * tileSize, miny + (row + 1) * tileSize));
+        chunks.push_back(chunk);
+      }
+    }
+  }
+  if (threedfy_chunks(chunks, nodes, outputs, polygonFiles, fileList, bIncremental, bStitching, tileHalo, journal) == false)
+    return 0;
+
+  //-- bye-bye
+  auto duration = boost::chrono::high_resolution_clock::now() - startTime;
+  printf("Successfully terminated in %lld seconds || %02d:%02d:%02d\n",
+    boost::chrono::duration_cast<boost::chrono::seconds>(duration).count(),
+    boost::chrono::duration_cast<boost::chrono::hours>(duration).count(),
+    boost::chrono::duration_cast<boost::chrono::minutes>(duration).count() % 60,
+    (int)boost::chrono::duration_cast<boost::chrono::seconds>(duration).count() % 60
+  );
+  return 1;
+}
+
+//-- reads the polygons (in the requested extent, or in the tile and its halo) and the points,
+//-- or the snapshot of a previous run with the same inputs. In incremental mode, only the
+//-- polygons that changed since the snapshot get the points. A tile without polygons is
+//-- left empty, its points are not read.
+bool read_polygons_and_points(Map3d& map3d, std::vector<PolygonFile>& polygonFiles, std::vector<PointFile>& pointFiles, std::string snapshot, bool bIncremental, bool tiled, Journal& journal, std::string chunk) {
+  std::string polygonsKey, pointsKey;
+  bool fromSnapshot = false;
+  bool incremental = false;
+  std::vector<TopoFeature*> dirty;
+  if (snapshot.empty() == false) {
+    polygonsKey = map3d.get_snapshot_polygons_key(polygonFiles);
+    pointsKey = map3d.get_snapshot_points_key(pointFiles);
+    if (polygonsKey.empty() == true || pointsKey.empty() == true)
+      std::clog << "Warning: snapshot not used, the inputs are not all files.\n";
+    else if (map3d.read_snapshot(snapshot, polygonsKey, pointsKey) == true) {
+      std::clog << "Polygons and points read from the snapshot " << snapshot << std::endl;
+      fromSnapshot = true;
+    }
+    else if (journal.has("points" + chunk) == true)
+      std::clog << "Warning: the points were read by the interrupted run but its snapshot cannot be used, reading them again.\n";
+    else if (bIncremental == true && map3d.add_polygons_files_incremental(polygonFiles, snapshot, pointsKey, dirty) == true) {
+      std::clog << "Points of the unchanged polygons read from the snapshot " << snapshot << std::endl;
+      incremental = true;
+    }
+  }
+  if (fromSnapshot == false && incremental == false) {
+    bool added = map3d.add_polygons_files(polygonFiles);
+    if (!added) {
+      std::cerr << "ERROR: Missing polygon data, cannot 3dfy the dataset. Aborting.\n";
+      return false;
+    }
+  }
+  std::clog << "\nTotal # of polygons: " << boost::locale::as::number << map3d.get_num_polygons() << std::endl;
+  if (tiled == true && map3d.get_num_polygons() == 0)
+    return true;
+  if (tiled == true)
+    map3d.check_tile_halo();
+
+  //-- spatially index the polygons (in incremental mode, only the changed ones while reading the points)
+  if (incremental == true)
+    map3d.construct_rtree(dirty);
+  else
+    map3d.construct_rtree();
+  print_memory_stage("reading polygons");
+
+  //-- print bbox from _rtree
+  Box2 b = map3d.get_bbox();
+  std::clog << std::setprecision(3) << std::fixed;
+  std::clog << "Spatial extent: ("
+    << bg::get<bg::min_corner, 0>(b) << ", "
+    << bg::get<bg::min_corner, 1>(b) << ") ("
+    << bg::get<bg::max_corner, 0>(b) << ", "
+    << bg::get<bg::max_corner, 1>(b) << ")\n";
+  
   auto startPoints = boost::chrono::high_resolution_clock::now();
 
-  for (auto file : fileList) {
+  bool skipPoints = fromSnapshot || (incremental && dirty.empty());
+  bool bElevData = skipPoints;
+  for (auto file : pointFiles) {
+    if (skipPoints == true)
+      break;
     bool added = map3d.add_las_file(file);
     if (!added) {
       bElevData = false;
@@ -338,7 +508,7 @@ int main(int argc, const char * argv[]) {
 
   if (bElevData == false) {
     std::cerr << "ERROR: Missing elevation data, cannot 3dfy the dataset. Aborting.\n";
-    return 0;
+    return false;
   }
 
   auto durationPoints = boost::chrono::high_resolution_clock::now() - startPoints;
@@ -348,39 +518,140 @@ int main(int argc, const char * argv[]) {
     boost::chrono::duration_cast<boost::chrono::minutes>(durationPoints).count() % 60,
     (int)boost::chrono::duration_cast<boost::chrono::seconds>(durationPoints).count() % 60
   );
+  print_memory_stage("reading points");
+  if (incremental == true)
+    map3d.construct_rtree();
+  if (fromSnapshot == false && polygonsKey.empty() == false && pointsKey.empty() == false) {
+    if (map3d.write_snapshot(snapshot, polygonsKey, pointsKey) == true) {
+      std::clog << "Snapshot written: " << snapshot << std::endl;
+      journal.add("points" + chunk);
+    }
+    else
+      std::cerr << "Warning: could not write the snapshot " << snapshot << std::endl;
+  }
+  return true;
+}
 
-  n = nodes["output"];
-  std::string format = n["format"].as<std::string>();
-  std::clog << "Lifting all input polygons to 3D...\n";
-  if (format == "CSV-BUILDINGS")
-    map3d.threeDfy(false);
-  else if (format == "OBJ-BUILDINGS") {
-    map3d.threeDfy(false);
-    map3d.construct_CDT();
+//-- the outputs of the config: 'output' is one output (written to the file of -o), or a list
+//-- of outputs, each with its format, its path (the file of -o if none) and its options
+std::vector<Output> get_outputs(YAML::Node n, std::string ofname) {
+  std::vector<Output> outputs;
+  if (n.IsSequence() == false) {
+    Output output;
+    output.format = n["format"].as<std::string>();
+    output.path = ofname;
+    output.options = n;
+    outputs.push_back(output);
+    return outputs;
   }
-  else if (format == "CSV-BUILDINGS-MULTIPLE")
-    std::clog << "CSV-BUILDINGS-MULTIPLE: no 3D reconstruction" << std::endl;
-  else if (format == "CSV-BUILDINGS-ALL-Z")
-    std::clog << "CSV-BUILDINGS-ALL-Z: no 3D reconstruction" << std::endl;
-  else {
-    map3d.threeDfy(bStitching);
-    map3d.construct_CDT();
+  for (auto it = n.begin(); it != n.end(); ++it) {
+    Output output;
+    output.format = (*it)["format"].as<std::string>();
+    output.path = ofname;
+    if ((*it)["path"])
+      output.path = (*it)["path"].as<std::string>();
+    output.options = YAML::Node(YAML::NodeType::Map);
+    if ((*it)["options"])
+      output.options = (*it)["options"];
+    outputs.push_back(output);
+  }
+  return outputs;
+}
+
+bool has_building_floor(const Output& output) {
+  YAML::Node n = output.options;
+  return (n["building_floor"] && n["building_floor"].as<std::string>() == "true");
+}
+
+//-- the stages and the classes of features that the output format needs: the outputs of the
+//-- buildings only need the buildings (their heights do not depend on the other features),
+//-- without stitching; the CSV of the heights at several percentiles and of all the z values
+//-- only need the points of the buildings, not their lifting
+//-- outputs are written from the samples of the points, before lifting
+StagePlan plan_stages(std::string format, bool bStitching) {
+  StagePlan plan;
+  plan.stitch = bStitching;
+  if (format == "CSV-BUILDINGS" || format == "OBJ-BUILDINGS" || format == "CSV-BUILDINGS-MULTIPLE" || format == "CSV-BUILDINGS-ALL-Z") {
+    plan.classes.insert("Building");
+    plan.stitch = false;
   }
+  if (format == "CSV-BUILDINGS" || format == "CSV-BUILDINGS-MULTIPLE" || format == "CSV-BUILDINGS-ALL-Z")
+    plan.cdt = false;
+  if (format == "CSV-BUILDINGS-MULTIPLE" || format == "CSV-BUILDINGS-ALL-Z") {
+    plan.lift = false;
+    plan.samples = true;
+  }
+  return plan;
+}
+
+//-- the features are lifted once for all the outputs, with all that they need; the outputs
+//-- written from the samples only add their classes
+StagePlan plan_outputs(const std::vector<Output>& outputs, bool bStitching) {
+  StagePlan plan;
+  plan.lift = plan.stitch = plan.cdt = false;
+  bool allclasses = false;
+  for (auto& output : outputs) {
+    StagePlan p = plan_stages(output.format, bStitching);
+    if (p.classes.empty() == true)
+      allclasses = true;
+    plan.classes.insert(p.classes.begin(), p.classes.end());
+    plan.lift = plan.lift || p.lift;
+    plan.stitch = plan.stitch || p.stitch;
+    plan.cdt = plan.cdt || p.cdt;
+  }
+  if (allclasses == true)
+    plan.classes.clear();
+  return plan;
+}
+
+//-- the layers of the classes not in the plan are not read: no features, no points assigned to them
+void remove_unneeded_layers(std::vector<PolygonFile>& polygonFiles, const StagePlan& plan) {
+  if (plan.classes.empty() == true)
+    return;
+  std::vector<PolygonFile> kept;
+  for (auto& file : polygonFiles) {
+    std::vector< std::pair<std::string, std::string> > layers;
+    for (auto& layer : file.layers) {
+      if (plan.classes.count(layer.second) > 0)
+        layers.push_back(layer);
+      else
+        std::clog << "Skipping " << (layer.first.empty() ? "the layers" : "layer " + layer.first) << " of " << file.filename << ": " << layer.second << " not needed for the output\n";
+    }
+    if (layers.empty() == false) {
+      file.layers = layers;
+      kept.push_back(file);
+    }
+  }
+  polygonFiles.swap(kept);
+}
+
+//-- lifts the features, only as much as the output format needs
+void lift_features(Map3d& map3d, const StagePlan& plan) {
+  if (plan.lift == false) {
+    std::clog << "No 3D reconstruction needed for the output" << std::endl;
+    return;
+  }
+  std::clog << "Lifting all input polygons to 3D...\n";
+  map3d.threeDfy(plan.stitch);
+  if (plan.cdt == true)
+    map3d.construct_CDT();
   std::clog << "done with calculations.\n";
+}
 
-  //-- output
-  std::clock_t startFileWriting = std::clock(); 
-  if (n["building_floor"].as<std::string>() == "true")
-    map3d.set_building_include_floor(true);
+//-- the formats written to one stream (the other ones are written by GDAL or to several files)
+bool is_stream_format(std::string format) {
+  return (format != "Shapefile" && format != "Shapefile-Multi" && format != "CityGML-Multifile" && format != "CityGML-IMGeo-Multifile" &&
+          format != "PostGIS" && format != "PostGIS-Multi" && format != "PostGIS-PDOK" && format != "GDAL");
+}
+
+//-- writes the features in the format, to the stream of or (if not a stream format) to ofname
+//-- (it does not change the map, the outputs of a map are written at the same time)
+bool write_output(Map3d& map3d, YAML::Node n, std::string format, std::string ofname, std::ostream& of) {
   int z_exaggeration = 0;
   if (n["vertical_exaggeration"])
     z_exaggeration = n["vertical_exaggeration"].as<int>();
 
   bool fileWritten = true;
-  std::ofstream of;
-  if (format != "Shapefile" && format != "CityGML-Multifile" && format != "CityGML-IMGeo-Multifile" && format != "PostGIS" && format != "PostGIS-Multi" && format != "PostGIS-PDOK")
-    of.open(ofname);
-
   if (format == "CityGML") {
     std::clog << "CityGML output\n";
     map3d.get_citygml(of);
@@ -442,25 +713,311 @@ int main(int argc, const char * argv[]) {
     std::clog << "GDAL output using driver '" + driver + "'\n";
     fileWritten = map3d.get_gdal_output(ofname, driver, false);
   }
-  of.close();
+  return fileWritten;
+}
+
+//-- writes the output of the features; the files written with a stream get their name once
+//-- complete, an interrupted run leaves only a .part file
+bool write_features(Map3d& map3d, YAML::Node n, std::string format, std::string ofname) {
+  std::clock_t startFileWriting = std::clock(); 
+  std::string partname = ofname + ".part";
+  std::ofstream of;
+  if (is_stream_format(format) == true)
+    of.open(partname);
+  bool fileWritten = write_output(map3d, n, format, ofname, of);
+  if (of.is_open() == true) {
+    of.close();
+    boost::system::error_code ec;
+    if (of.fail() == true)
+      fileWritten = false;
+    else {
+      boost::filesystem::rename(partname, ofname, ec);
+      fileWritten = !ec;
+    }
+  }
 
   if (fileWritten) {
     printf("Features written in %ld ms\n", std::clock() - startFileWriting);
   }
   else {
     std::cerr << "ERROR: Writing features failed. Aborting.\n";
-    return 0;
+    return false;
   }
+  print_memory_stage("writing output");
+  return true;
+}
 
-  //-- bye-bye
-  auto duration = boost::chrono::high_resolution_clock::now() - startTime;
-  printf("Successfully terminated in %lld seconds || %02d:%02d:%02d\n",
-    boost::chrono::duration_cast<boost::chrono::seconds>(duration).count(),
-    boost::chrono::duration_cast<boost::chrono::hours>(duration).count(),
-    boost::chrono::duration_cast<boost::chrono::minutes>(duration).count() % 60,
-    (int)boost::chrono::duration_cast<boost::chrono::seconds>(duration).count() % 60
-  );
-  return 1;
+//-- 3dfies the chunks with a task graph: each chunk is read, lifted and written, in this order,
+//-- and the chunks overlap (one is lifted or written while the points of the next ones are
+//-- read). To bound the memory, at most 'tiles_in_memory' chunks (2 by default) are in memory:
+//-- the reading of a chunk waits for the release of the one 'tiles_in_memory' chunks before it.
+//-- The threads of the options are shared between the chunks in memory and the work inside each
+//-- of them. With several chunks in memory, the memory peaks logged are those of the process and
+//-- the lines logged are prefixed with their tile.
+//-- A chunk is lifted once for all the outputs, which are then written at the same time (those
+//-- written from the samples of the points are written before lifting).
+bool threedfy_chunks(std::vector<Chunk>& chunks, YAML::Node nodes, std::vector<Output>& outputs, std::vector<PolygonFile>& polygonFiles, std::vector<PointFile>& pointFiles, bool bIncremental, bool bStitching, double tileHalo, Journal& journal) {
+  if (chunks.empty() == true)
+    return true;
+  int threads = 0;
+  if (nodes["options"]["threads"])
+    threads = nodes["options"]["threads"].as<int>();
+  threads = get_number_of_threads(threads);
+  int tilesInMemory = 2;
+  if (nodes["options"]["tiles_in_memory"])
+    tilesInMemory = nodes["options"]["tiles_in_memory"].as<int>();
+  std::size_t inflight = std::min(chunks.size(), std::size_t(tilesInMemory));
+  set_memory_peak_per_stage(inflight == 1);
+  set_log_per_line(inflight > 1);
+  StagePlan plan = plan_outputs(outputs, bStitching);
+  bool floor = false;
+  for (auto& output : outputs)
+    floor = floor || has_building_floor(output);
+
+  //-- all that the tasks use is prepared here: the YAML nodes and the input files (whose layers
+  //-- are listed while reading) are not shared between threads
+  std::vector< std::unique_ptr<Map3d> > maps;
+  std::vector< std::vector<PolygonFile> > files(chunks.size(), polygonFiles);
+  std::vector< std::vector<YAML::Node> > options(chunks.size());
+  std::vector<char> empty(chunks.size(), 0); //-- a tile without polygons is not written
+  TaskGraph graph;
+  std::vector<TaskGraph::TaskId> released;
+  auto tag = [&](std::size_t i) {
+    if (inflight > 1)
+      set_log_prefix(chunks[i].tiled ? "[tile" + chunks[i].name + "] " : "");
+  };
+  auto write = [&](std::size_t i, std::size_t k) {
+    tag(i);
+    if (empty[i] == 1)
+      return true;
+    return write_features(*maps[i], options[i][k], outputs[k].format, chunks[i].ofnames[k]);
+  };
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    maps.emplace_back(new Map3d());
+    set_map3d_options(*maps[i], nodes, false);
+    maps[i]->set_number_of_threads(std::max(1, threads / int(inflight)));
+    maps[i]->set_building_include_floor(floor);
+    if (chunks[i].tiled == true)
+      maps[i]->set_tile(bg::get<bg::min_corner, 0>(chunks[i].tile), bg::get<bg::min_corner, 1>(chunks[i].tile),
+                        bg::get<bg::max_corner, 0>(chunks[i].tile), bg::get<bg::max_corner, 1>(chunks[i].tile), tileHalo);
+    for (auto& output : outputs)
+      options[i].push_back(YAML::Clone(output.options));
+
+    std::vector<TaskGraph::TaskId> previous;
+    if (i >= inflight)
+      previous.push_back(released[i - inflight]);
+    TaskGraph::TaskId read = graph.add_task("read", [&, i]() {
+      tag(i);
+      if (chunks[i].tiled == true)
+        std::clog << "\n=====  TILE" << chunks[i].name << " =====\n";
+      if (read_polygons_and_points(*maps[i], files[i], pointFiles, chunks[i].snapshot, bIncremental, chunks[i].tiled, journal, chunks[i].name) == false)
+        return false;
+      empty[i] = (chunks[i].tiled == true && maps[i]->get_num_polygons() == 0);
+      return true;
+    }, previous);
+    std::vector<TaskGraph::TaskId> samples(1, read);
+    for (std::size_t k = 0; k < outputs.size(); k++) {
+      if (plan_stages(outputs[k].format, bStitching).samples == true)
+        samples.push_back(graph.add_task("write", [&, i, k]() { return write(i, k); }, std::vector<TaskGraph::TaskId>(1, read)));
+    }
+    TaskGraph::TaskId lift = graph.add_task("3dfy", [&, i]() {
+      tag(i);
+      if (empty[i] == 0) {
+        lift_features(*maps[i], plan);
+        maps[i]->print_memory_usage();
+        maps[i]->remove_features_outside_tile();
+      }
+      return true;
+    }, samples);
+    std::vector<TaskGraph::TaskId> written(1, lift);
+    for (std::size_t k = 0; k < outputs.size(); k++) {
+      if (plan_stages(outputs[k].format, bStitching).samples == false)
+        written.push_back(graph.add_task("write", [&, i, k]() { return write(i, k); }, std::vector<TaskGraph::TaskId>(1, lift)));
+    }
+    released.push_back(graph.add_task("release", [&, i]() {
+      tag(i);
+      if (empty[i] == 1)
+        std::clog << "No polygons in the tile" << chunks[i].name << ", skipping it.\n";
+      maps[i].reset(); //-- the memory of the chunk is given back
+      return journal.add("output" + chunks[i].name);
+    }, written));
+  }
+  bool wentgood = graph.run(threads);
+  set_log_prefix("");
+  set_log_per_line(false);
+  set_memory_peak_per_stage(true);
+  graph.print_metrics();
+  return wentgood;
+}
+
+//-- reads the polygons and the points once, then for each request 3dfies the features in the
+//-- requested extent (with those in a halo around it, for the stitching) and replies with the
+//-- output (empty if there are no features). A request is "xmin,ymin,xmax,ymax [format]",
+//-- the format of the (first) output of the config is used if none is given; it must be a format written to a stream.
+bool run_daemon(Map3d& map3d, Map3d& request, std::vector<PolygonFile>& polygonFiles, std::vector<PointFile>& pointFiles, const Output& output, std::string snapshot, bool bStitching, double tileHalo, int port) {
+  Journal journal; //-- not opened, a daemon has nothing to resume
+  if (read_polygons_and_points(map3d, polygonFiles, pointFiles, snapshot, false, false, journal, "") == false)
+    return false;
+  map3d.print_memory_usage();
+  request.set_building_include_floor(has_building_floor(output));
+  RequestHandler handler = [&](const std::string& line, std::ostream& reply, std::string& error) {
+    std::vector<std::string> tokens = stringsplit(line, ' ');
+    std::string format = output.format;
+    if (tokens.size() == 2)
+      format = tokens[1];
+    std::vector<std::string> extent_split;
+    if (tokens.empty() == false)
+      extent_split = stringsplit(tokens[0], ',');
+    double xmin, xmax, ymin, ymax;
+    try {
+      if (tokens.size() < 1 || tokens.size() > 2 || extent_split.size() != 4)
+        throw boost::bad_lexical_cast();
+      xmin = boost::lexical_cast<double>(extent_split[0]);
+      ymin = boost::lexical_cast<double>(extent_split[1]);
+      xmax = boost::lexical_cast<double>(extent_split[2]);
+      ymax = boost::lexical_cast<double>(extent_split[3]);
+    }
+    catch (boost::bad_lexical_cast& e) {
+      error = "invalid request, must be 'xmin,ymin,xmax,ymax [format]'";
+      return false;
+    }
+    if (xmin >= xmax || ymin >= ymax) {
+      error = "invalid extent";
+      return false;
+    }
+    if (format != "CityGML" && format != "CityGML-IMGeo" && format != "OBJ" && format != "OBJ-NoID" &&
+        format != "CSV-BUILDINGS" && format != "CSV-BUILDINGS-MULTIPLE" && format != "CSV-BUILDINGS-ALL-Z") {
+      error = "format " + format + " cannot be sent as a reply";
+      return false;
+    }
+    auto startRequest = boost::chrono::high_resolution_clock::now();
+    request.set_tile(xmin, ymin, xmax, ymax, tileHalo);
+    bool wentgood = request.add_features_from(map3d);
+    if (wentgood == true && request.get_num_polygons() > 0) {
+      request.construct_rtree();
+      lift_features(request, plan_stages(format, bStitching));
+      request.remove_features_outside_tile();
+      wentgood = write_output(request, output.options, format, "", reply);
+    }
+    request.clear_features();
+    if (wentgood == false) {
+      error = "3dfying the extent failed";
+      return false;
+    }
+    std::clog << "Request done in " << boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::high_resolution_clock::now() - startRequest).count() << " ms\n";
+    return true;
+  };
+  return serve_requests(port, handler);
+}
+
+//-- the lifting options and the options of the config stored in the Map3d
+void set_map3d_options(Map3d& map3d, YAML::Node nodes, bool verbose) {
+  YAML::Node n = nodes["lifting_options"];
+  if (n["Building"]) {
+    if (n["Building"]["height_roof"]) {
+      std::string height = n["Building"]["height_roof"].as<std::string>();
+      map3d.set_building_heightref_roof(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+    if (n["Building"]["height_floor"]) {
+      std::string height = n["Building"]["height_floor"].as<std::string>();
+      map3d.set_building_heightref_floor(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+    if (n["Building"]["lod"]) {
+      map3d.set_building_lod(n["Building"]["lod"].as<int>());
+    }
+    if (n["Building"]["triangulate"]) {
+      if (n["Building"]["triangulate"].as<std::string>() == "true")
+        map3d.set_building_triangulate(true);
+      else
+        map3d.set_building_triangulate(false);
+    }
+  }
+  if (n["Terrain"]) {
+    if (n["Terrain"]["simplification"])
+      map3d.set_terrain_simplification(n["Terrain"]["simplification"].as<int>());
+    if (n["Terrain"]["simplification_tinsimp"])
+      map3d.set_terrain_simplification_tinsimp(n["Terrain"]["simplification_tinsimp"].as<double>());
+    if (n["Terrain"]["max_points"])
+      map3d.set_terrain_max_points(n["Terrain"]["max_points"].as<unsigned long>());
+    if (n["Terrain"]["innerbuffer"])
+      map3d.set_terrain_innerbuffer(n["Terrain"]["innerbuffer"].as<float>());
+  }
+  if (n["Forest"]) {
+    if (n["Forest"]["simplification"])
+      map3d.set_forest_simplification(n["Forest"]["simplification"].as<int>());
+    if (n["Forest"]["simplification_tinsimp"])
+      map3d.set_forest_simplification_tinsimp(n["Forest"]["simplification_tinsimp"].as<double>());
+    if (n["Forest"]["max_points"])
+      map3d.set_forest_max_points(n["Forest"]["max_points"].as<unsigned long>());
+    if (n["Forest"]["innerbuffer"])
+      map3d.set_forest_innerbuffer(n["Forest"]["innerbuffer"].as<float>());
+    if (n["Forest"]["ground_points_only"] && n["Forest"]["ground_points_only"].as<std::string>() == "true")
+      map3d.set_forest_ground_points_only(true);
+  }
+  if (n["Water"]) {
+    if (n["Water"]["height"]) {
+      std::string height = n["Water"]["height"].as<std::string>();
+      map3d.set_water_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+  }
+  if (n["Road"]) {
+    if (n["Road"]["height"]) {
+      std::string height = n["Road"]["height"].as<std::string>();
+      map3d.set_road_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+  }
+  if (n["Separation"]) {
+    if (n["Separation"]["height"]) {
+      std::string height = n["Separation"]["height"].as<std::string>();
+      map3d.set_separation_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+  }
+  if (n["Bridge/Overpass"]) {
+    if (n["Bridge/Overpass"]["height"]) {
+      std::string height = n["Bridge/Overpass"]["height"].as<std::string>();
+      map3d.set_bridge_heightref(std::stof(height.substr(height.find_first_of("-") + 1)) / 100);
+    }
+  }
+
+  n = nodes["options"];
+  if (n["radius_vertex_elevation"])
+    map3d.set_radius_vertex_elevation(n["radius_vertex_elevation"].as<float>());
+  if (n["building_radius_vertex_elevation"])
+    map3d.set_building_radius_vertex_elevation(n["building_radius_vertex_elevation"].as<float>());
+  if (n["threshold_jump_edges"])
+    map3d.set_threshold_jump_edges(n["threshold_jump_edges"].as<float>());
+  if (n["use_vertical_walls"] && n["use_vertical_walls"].as<std::string>() == "true")
+    map3d.set_use_vertical_walls(true);
+  if (n["threads"])
+    map3d.set_number_of_threads(n["threads"].as<int>());
+  if (n["validate_cdt"] && n["validate_cdt"].as<std::string>() == "true")
+    map3d.set_validate_cdt(true);
+  if (n["extent"]) {
+    std::vector<std::string> extent_split = stringsplit(n["extent"].as<std::string>(), ',');
+    double xmin, xmax, ymin, ymax;
+    bool wentgood = true;
+    try {
+      (n["radius_vertex_elevation"].as<std::string>());
+      xmin = boost::lexical_cast<double>(extent_split[0]);
+      ymin = boost::lexical_cast<double>(extent_split[1]);
+      xmax = boost::lexical_cast<double>(extent_split[2]);
+      ymax = boost::lexical_cast<double>(extent_split[3]);
+    }
+    catch (boost::bad_lexical_cast& e) {
+      wentgood = false;
+    }
+
+    if (!wentgood || xmin > xmax || ymin > ymax || boost::geometry::area(Box2(Point2(xmin, ymin), Point2(xmax, ymax))) <= 0.0) {
+      if (verbose == true)
+        std::cerr << "ERROR: The supplied extent is not valid: (" << n["extent"].as<std::string>() << "), using all polygons\n";
+    }
+    else
+    {
+      if (verbose == true)
+        std::clog << "Using extent for polygons: (" << n["extent"].as<std::string>() << ")\n";
+      map3d.set_requested_extent(xmin, ymin, xmax, ymax);
+    }
+  }
 }
 
 void print_license() {
@@ -588,6 +1145,21 @@ bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
         std::cerr << "\tOption 'Terrain.simplification' invalid; must be an integer.\n";
       }
     }
+    if (n["Terrain"]["simplification_tinsimp"]) {
+      try {
+        boost::lexical_cast<double>(n["Terrain"]["simplification_tinsimp"].as<std::string>());
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'Terrain.simplification_tinsimp' invalid; must be a float.\n";
+      }
+    }
+    if (n["Terrain"]["max_points"]) {
+      if (is_string_integer(n["Terrain"]["max_points"].as<std::string>(), 0, std::numeric_limits<int>::max()) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'Terrain.max_points' invalid; must be an integer >= 0.\n";
+      }
+    }
     if (n["Terrain"]["innerbuffer"]) {
       try {
         boost::lexical_cast<float>(n["Terrain"]["innerbuffer"].as<std::string>());
@@ -605,6 +1177,21 @@ bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
         std::cerr << "\tOption 'Forest.simplification' invalid; must be an integer.\n";
       }
     }
+    if (n["Forest"]["simplification_tinsimp"]) {
+      try {
+        boost::lexical_cast<double>(n["Forest"]["simplification_tinsimp"].as<std::string>());
+      }
+      catch (boost::bad_lexical_cast& e) {
+        wentgood = false;
+        std::cerr << "\tOption 'Forest.simplification_tinsimp' invalid; must be a float.\n";
+      }
+    }
+    if (n["Forest"]["max_points"]) {
+      if (is_string_integer(n["Forest"]["max_points"].as<std::string>(), 0, std::numeric_limits<int>::max()) == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'Forest.max_points' invalid; must be an integer >= 0.\n";
+      }
+    }
     if (n["Forest"]["innerbuffer"]) {
       try {
         boost::lexical_cast<float>(n["Forest"]["innerbuffer"].as<std::string>());
@@ -672,31 +1259,104 @@ bool validate_yaml(const char* arg, std::set<std::string>& allowedFeatures) {
       std::cerr << "\tOption 'options.threshold_jump_edges' invalid.\n";
     }
   }
-  //-- 5. output
-  n = nodes["output"];
-  std::string format = n["format"].as<std::string>();
-  if ((format != "OBJ") &&
-    (format != "OBJ-NoID") &&
-    (format != "CityGML") &&
-    (format != "CityGML-Multifile") &&
-    (format != "CityGML-IMGeo") &&
-    (format != "CityGML-IMGeo-Multifile") &&
-    (format != "OBJ-BUILDINGS") &&
-    (format != "CSV-BUILDINGS") &&
-    (format != "Shapefile") &&
-    (format != "Shapefile-Multi") &&
-    (format != "CSV-BUILDINGS-MULTIPLE") &&
-    (format != "CSV-BUILDINGS-ALL-Z") &&
-    (format != "PostGIS") &&
-    (format != "PostGIS-Multi") &&
-    (format != "PostGIS-PDOK") &&
-    (format != "GDAL")) {
-    wentgood = false;
-    std::cerr << "\tOption 'output.format' invalid (OBJ | OBJ-NoID | CityGML | CityGML-Multifile | CityGML-IMGeo | CityGML-IMGeo-Multifile | CSV-BUILDINGS | Shapefile | Shapefile-Multi | PostGIS | PostGIS-Multi | PostGIS-PDOK)\n";
+  if (n["threads"]) {
+    if (is_string_integer(n["threads"].as<std::string>(), 0, 1024) == false) {
+      wentgood = false;
+      std::cerr << "\tOption 'options.threads' invalid; must be an integer (0 is one per core).\n";
+    }
+  }
+  if (n["tiles_in_memory"]) {
+    try {
+      if (boost::lexical_cast<int>(n["tiles_in_memory"].as<std::string>()) < 1)
+        throw boost::bad_lexical_cast();
+    }
+    catch (boost::bad_lexical_cast& e) {
+      wentgood = false;
+      std::cerr << "\tOption 'options.tiles_in_memory' invalid; must be an integer of at least 1.\n";
+    }
   }
-  if (format == "GDAL" && (!n["gdal_driver"] || n["gdal_driver"].as<std::string>().empty())) {
+  double tileSize = 0.0; //-- 0 is no tiles
+  if (n["tile_size"]) {
+    try {
+      tileSize = boost::lexical_cast<double>(n["tile_size"].as<std::string>());
+      if (tileSize < 0.0)
+        throw boost::bad_lexical_cast();
+    }
+    catch (boost::bad_lexical_cast& e) {
+      wentgood = false;
+      std::cerr << "\tOption 'options.tile_size' invalid; must be a positive number (0 is no tiles).\n";
+    }
+  }
+  if (n["incremental"] && n["incremental"].as<std::string>() == "true" && !n["snapshot"]) {
     wentgood = false;
-    std::cerr << "\tOption 'output.format' GDAL needs gdal_driver setting\n";
+    std::cerr << "\tOption 'options.incremental' needs the option 'options.snapshot'.\n";
+  }
+  if (n["tile_halo"]) {
+    try {
+      if (boost::lexical_cast<double>(n["tile_halo"].as<std::string>()) < 0.0)
+        throw boost::bad_lexical_cast();
+    }
+    catch (boost::bad_lexical_cast& e) {
+      wentgood = false;
+      std::cerr << "\tOption 'options.tile_halo' invalid; must be a positive number.\n";
+    }
+  }
+  //-- 5. output: one output, or a list of outputs each with its format, path and options
+  n = nodes["output"];
+  std::vector< std::pair<YAML::Node, YAML::Node> > outputs; //-- the format and the options of each
+  if (n.IsSequence() == true) {
+    std::set<std::string> paths;
+    for (auto it = n.begin(); it != n.end(); ++it) {
+      if (!(*it)["format"]) {
+        wentgood = false;
+        std::cerr << "\tOption 'output' invalid; each output needs a format.\n";
+        continue;
+      }
+      std::string path;
+      if ((*it)["path"])
+        path = (*it)["path"].as<std::string>();
+      if (paths.insert(path).second == false) {
+        wentgood = false;
+        std::cerr << "\tOption 'output.path' invalid; the outputs must have different paths (at most one without, written to the file of -o).\n";
+      }
+      outputs.emplace_back((*it)["format"], (*it)["options"] ? (*it)["options"] : YAML::Node(YAML::NodeType::Map));
+    }
+    if (n.size() == 0) {
+      wentgood = false;
+      std::cerr << "\tOption 'output' invalid; the list of outputs is empty.\n";
+    }
+  }
+  else
+    outputs.emplace_back(n["format"], n);
+  for (auto& output : outputs) {
+    std::string format = output.first.as<std::string>();
+    if ((format != "OBJ") &&
+      (format != "OBJ-NoID") &&
+      (format != "CityGML") &&
+      (format != "CityGML-Multifile") &&
+      (format != "CityGML-IMGeo") &&
+      (format != "CityGML-IMGeo-Multifile") &&
+      (format != "OBJ-BUILDINGS") &&
+      (format != "CSV-BUILDINGS") &&
+      (format != "Shapefile") &&
+      (format != "Shapefile-Multi") &&
+      (format != "CSV-BUILDINGS-MULTIPLE") &&
+      (format != "CSV-BUILDINGS-ALL-Z") &&
+      (format != "PostGIS") &&
+      (format != "PostGIS-Multi") &&
+      (format != "PostGIS-PDOK") &&
+      (format != "GDAL")) {
+      wentgood = false;
+      std::cerr << "\tOption 'output.format' invalid (OBJ | OBJ-NoID | CityGML | CityGML-Multifile | CityGML-IMGeo | CityGML-IMGeo-Multifile | CSV-BUILDINGS | Shapefile | Shapefile-Multi | PostGIS | PostGIS-Multi | PostGIS-PDOK)\n";
+    }
+    if (format == "GDAL" && (!output.second["gdal_driver"] || output.second["gdal_driver"].as<std::string>().empty())) {
+      wentgood = false;
+      std::cerr << "\tOption 'output.format' GDAL needs gdal_driver setting\n";
+    }
+    if (tileSize > 0.0 && (format == "PostGIS" || format == "PostGIS-Multi" || format == "PostGIS-PDOK")) {
+      wentgood = false;
+      std::cerr << "\tOption 'options.tile_size' cannot be used with output format " << format << ".\n";
+    }
   }
 
   return wentgood;
@@ -0,0 +1,285 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "merge.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+//-- "out_col_row.ext" for a file, "prefix_col_row" for a prefix (multifile outputs)
+std::string get_tile_filename(std::string ofname, int col, int row) {
+  std::string suffix = "_" + std::to_string(col) + "_" + std::to_string(row);
+  boost::filesystem::path path(ofname);
+  if (path.has_extension() == false)
+    return ofname + suffix;
+  return (path.parent_path() / (path.stem().string() + suffix + path.extension().string())).string();
+}
+
+//-- the files written for the tiles of ofname, in the order the tiles are processed (row by row)
+std::vector<std::string> find_tile_files(std::string ofname) {
+  boost::filesystem::path path(ofname);
+  boost::filesystem::path dir = path.parent_path();
+  if (dir.empty())
+    dir = ".";
+  std::string prefix = path.stem().string() + "_";
+  std::string extension = path.extension().string();
+  std::vector< std::pair< std::pair<int, int>, std::string > > tiles;
+  boost::system::error_code ec;
+  for (boost::filesystem::directory_iterator it(dir, ec), end; it != end; it.increment(ec)) {
+    std::string name = it->path().filename().string();
+    if (name.size() <= prefix.size() + extension.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+      continue;
+    //-- what is left must be "col_row"
+    std::string index = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+    std::size_t sep = index.find('_');
+    if (sep == std::string::npos || sep == 0 || sep == index.size() - 1 ||
+        index.find_first_not_of("0123456789_") != std::string::npos || index.find('_', sep + 1) != std::string::npos)
+      continue;
+    int col = std::stoi(index.substr(0, sep));
+    int row = std::stoi(index.substr(sep + 1));
+    tiles.push_back(std::make_pair(std::make_pair(row, col), it->path().string()));
+  }
+  std::sort(tiles.begin(), tiles.end());
+  std::vector<std::string> files;
+  for (auto& t : tiles)
+    files.push_back(t.second);
+  return files;
+}
+
+//-- the envelope of a CityGML header is replaced by the one of all the tiles
+static bool merge_citygml(std::vector<std::string>& files, std::ostream& of) {
+  const std::string lower = "<gml:lowerCorner>";
+  const std::string upper = "<gml:upperCorner>";
+  double minx = 1e20, miny = 1e20, maxx = -1e20, maxy = -1e20;
+  for (auto& file : files) {
+    std::ifstream ifs(file);
+    std::string line;
+    while (std::getline(ifs, line)) {
+      std::size_t l = line.find(lower);
+      std::size_t u = line.find(upper);
+      if (l != std::string::npos && u != std::string::npos) {
+        double x, y;
+        std::istringstream(line.substr(l + lower.size())) >> x >> y;
+        minx = std::min(minx, x);
+        miny = std::min(miny, y);
+        std::istringstream(line.substr(u + upper.size())) >> x >> y;
+        maxx = std::max(maxx, x);
+        maxy = std::max(maxy, y);
+        break;
+      }
+    }
+  }
+  of << std::setprecision(3) << std::fixed;
+  for (auto& file : files) {
+    std::ifstream ifs(file);
+    if (ifs.is_open() == false) {
+      std::cerr << "ERROR: cannot read " << file << std::endl;
+      return false;
+    }
+    std::string line;
+    bool inheader = true;
+    while (std::getline(ifs, line)) {
+      if (inheader == true) {
+        std::size_t l = line.find(lower);
+        std::size_t u = line.find(upper);
+        if (l != std::string::npos && u != std::string::npos) {
+          inheader = false;
+          if (file == files.front()) {
+            of << line.substr(0, l) << lower << minx << " " << miny << " 0";
+            std::size_t le = line.find("</gml:lowerCorner>");
+            of << line.substr(le, u - le) << upper << maxx << " " << maxy << " 100";
+            of << line.substr(line.find("</gml:upperCorner>")) << "\n";
+          }
+        }
+        else if (file == files.front())
+          of << line << "\n";
+      }
+      else if (line != "</CityModel>")
+        of << line << "\n";
+    }
+  }
+  of << "</CityModel>\n";
+  return true;
+}
+
+//-- the vertices shared by tiles are written once, the faces are renumbered
+static bool merge_obj(std::vector<std::string>& files, std::ostream& of) {
+  std::unordered_map<std::string, unsigned long> vertices;
+  of << "mtllib ./3dfier.mtl\n";
+  for (auto& file : files) {
+    std::ifstream ifs(file);
+    if (ifs.is_open() == false) {
+      std::cerr << "ERROR: cannot read " << file << std::endl;
+      return false;
+    }
+    //-- first the vertices (new index of each vertex of the file), then the faces
+    std::vector<unsigned long> newindex(1, 0);
+    std::string line;
+    while (std::getline(ifs, line)) {
+      if (line.compare(0, 2, "v ") != 0)
+        continue;
+      auto it = vertices.find(line);
+      if (it == vertices.end()) {
+        it = vertices.emplace(line, vertices.size() + 1).first;
+        of << line << "\n";
+      }
+      newindex.push_back(it->second);
+    }
+    ifs.clear();
+    ifs.seekg(0);
+    while (std::getline(ifs, line)) {
+      if (line.compare(0, 2, "v ") == 0 || line.compare(0, 7, "mtllib ") == 0 || line.empty())
+        continue;
+      if (line.compare(0, 2, "f ") == 0) {
+        std::istringstream iss(line.substr(2));
+        unsigned long i;
+        of << "f";
+        while (iss >> i) {
+          if (i >= newindex.size()) {
+            std::cerr << "ERROR: invalid face in " << file << std::endl;
+            return false;
+          }
+          of << " " << newindex[i];
+        }
+        of << "\n";
+      }
+      else
+        of << line << "\n";
+    }
+  }
+  return true;
+}
+
+//-- the header line is written once
+static bool merge_csv(std::vector<std::string>& files, std::ostream& of) {
+  for (auto& file : files) {
+    std::ifstream ifs(file);
+    if (ifs.is_open() == false) {
+      std::cerr << "ERROR: cannot read " << file << std::endl;
+      return false;
+    }
+    std::string line;
+    bool first = true;
+    while (std::getline(ifs, line)) {
+      if (first == false || file == files.front())
+        of << line << "\n";
+      first = false;
+    }
+  }
+  return true;
+}
+
+//-- the features of the layers with the same name are appended to one layer
+static bool merge_gdal(std::vector<std::string>& files, std::string ofname, std::string drivername) {
+#if GDAL_VERSION_MAJOR < 2
+  std::cerr << "ERROR: cannot merge GDAL outputs with GDAL < 2.0.\n";
+  return false;
+#else
+  if (GDALGetDriverCount() == 0)
+    GDALAllRegister();
+  GDALDriver *driver = GetGDALDriverManager()->GetDriverByName(drivername.c_str());
+  if (driver == NULL) {
+    std::cerr << "ERROR: GDAL driver '" << drivername << "' not found\n";
+    return false;
+  }
+  GDALDataset *dataSource = driver->Create(ofname.c_str(), 0, 0, 0, GDT_Unknown, NULL);
+  if (dataSource == NULL) {
+    std::cerr << "ERROR: Cannot open file '" + ofname + "' for writing" << std::endl;
+    return false;
+  }
+  bool wentgood = true;
+  for (auto& file : files) {
+    GDALDataset *tile = (GDALDataset*)GDALOpenEx(file.c_str(), GDAL_OF_READONLY | GDAL_OF_VECTOR, NULL, NULL, NULL);
+    if (tile == NULL) {
+      std::cerr << "ERROR: cannot read " << file << std::endl;
+      wentgood = false;
+      break;
+    }
+    for (int i = 0; i < tile->GetLayerCount(); i++) {
+      OGRLayer *tileLayer = tile->GetLayer(i);
+      OGRLayer *layer = dataSource->GetLayerByName(tileLayer->GetName());
+      //-- a Shapefile has one layer named after the file
+      if (layer == NULL && tile->GetLayerCount() == 1 && dataSource->GetLayerCount() == 1)
+        layer = dataSource->GetLayer(0);
+      if (layer == NULL) {
+        if (dataSource->CopyLayer(tileLayer, tileLayer->GetName()) == NULL) {
+          std::cerr << "ERROR: cannot create layer " << tileLayer->GetName() << std::endl;
+          wentgood = false;
+        }
+        continue;
+      }
+      OGRFeature *f;
+      tileLayer->ResetReading();
+      while ((f = tileLayer->GetNextFeature()) != NULL) {
+        OGRFeature *merged = OGRFeature::CreateFeature(layer->GetLayerDefn());
+        merged->SetFrom(f);
+        if (layer->CreateFeature(merged) != OGRERR_NONE) {
+          std::cerr << "ERROR: cannot write a feature of " << file << std::endl;
+          wentgood = false;
+        }
+        OGRFeature::DestroyFeature(merged);
+        OGRFeature::DestroyFeature(f);
+      }
+    }
+    GDALClose(tile);
+    if (wentgood == false)
+      break;
+  }
+  GDALClose(dataSource);
+  return wentgood;
+#endif
+}
+
+bool merge_tile_outputs(std::string format, std::string ofname, std::string gdaldriver) {
+  std::vector<std::string> files = find_tile_files(ofname);
+  if (files.empty() == true) {
+    std::cerr << "ERROR: no tiles of " << ofname << " found to merge.\n";
+    return false;
+  }
+  std::clog << "Merging " << files.size() << " tiles into " << ofname << std::endl;
+  if (format == "Shapefile")
+    return merge_gdal(files, ofname, "ESRI Shapefile");
+  if (format == "GDAL")
+    return merge_gdal(files, ofname, gdaldriver);
+  std::ofstream of(ofname);
+  bool wentgood;
+  if (format == "CityGML" || format == "CityGML-IMGeo")
+    wentgood = merge_citygml(files, of);
+  else if (format == "OBJ" || format == "OBJ-NoID" || format == "OBJ-BUILDINGS")
+    wentgood = merge_obj(files, of);
+  else if (format == "CSV-BUILDINGS" || format == "CSV-BUILDINGS-MULTIPLE" || format == "CSV-BUILDINGS-ALL-Z")
+    wentgood = merge_csv(files, of);
+  else {
+    std::cerr << "ERROR: the outputs in format " << format << " cannot be merged (one file per layer), merge them per layer.\n";
+    wentgood = false;
+  }
+  of.close();
+  return wentgood;
+}
@@ -0,0 +1,40 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef merge_h
+#define merge_h
+
+#include "definitions.h"
+
+//-- the outputs of the tiles (see options.tile_size and --shard) are written to one file per
+//-- tile, named after the output with the index of the tile; --merge combines them
+std::string get_tile_filename(std::string ofname, int col, int row);
+std::vector<std::string> find_tile_files(std::string ofname);
+bool merge_tile_outputs(std::string format, std::string ofname, std::string gdaldriver);
+
+#endif /* merge_h */
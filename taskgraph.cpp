@@ -0,0 +1,143 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "taskgraph.h"
+#include "threadpool.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <set>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+
+//-- the dependencies must be tasks already added, so the graph has no cycle
+TaskGraph::TaskId TaskGraph::add_task(std::string type, std::function<bool()> job, const std::vector<TaskId>& dependencies) {
+  TaskId id = _tasks.size();
+  Task task;
+  task.type = type;
+  task.job = job;
+  task.remaining = dependencies.size();
+  _tasks.push_back(task);
+  for (auto& d : dependencies)
+    _tasks[d].dependents.push_back(id);
+  return id;
+}
+
+bool TaskGraph::run(int nthreads) {
+  typedef std::chrono::steady_clock Clock;
+  nthreads = get_number_of_threads(nthreads);
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::set<TaskId> ready;
+  std::vector<Clock::time_point> readysince(_tasks.size());
+  std::size_t done = 0;
+  std::size_t running = 0;
+  bool failed = false;
+  std::exception_ptr error = nullptr;
+  for (TaskId id = 0; id < _tasks.size(); id++) {
+    if (_tasks[id].remaining == 0) {
+      ready.insert(id);
+      readysince[id] = Clock::now();
+    }
+  }
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      //-- with nothing ready and nothing running, no task can become ready: all are done
+      cv.wait(lock, [&]() { return failed == true || ready.empty() == false || running == 0; });
+      if (failed == true || ready.empty() == true)
+        break;
+      TaskId id = *(ready.begin());
+      ready.erase(ready.begin());
+      running++;
+      Task& task = _tasks[id];
+      Clock::time_point start = Clock::now();
+      double wait = std::chrono::duration<double>(start - readysince[id]).count();
+      lock.unlock();
+      bool success = false;
+      try {
+        success = task.job();
+      }
+      catch (...) {
+        //-- keep the first exception, it is rethrown in the calling thread
+        lock.lock();
+        if (error == nullptr)
+          error = std::current_exception();
+        lock.unlock();
+      }
+      double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      lock.lock();
+      running--;
+      done++;
+      TaskMetrics& m = _metrics[task.type];
+      m.count++;
+      m.seconds += seconds;
+      m.maxseconds = std::max(m.maxseconds, seconds);
+      m.waitseconds += wait;
+      if (success == false)
+        failed = true;
+      else {
+        for (auto& d : task.dependents) {
+          if (--_tasks[d].remaining == 0) {
+            ready.insert(d);
+            readysince[d] = Clock::now();
+          }
+        }
+      }
+      cv.notify_all();
+    }
+    cv.notify_all();
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < nthreads; t++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+  return (failed == false && done == _tasks.size());
+}
+
+std::map<std::string, TaskMetrics> TaskGraph::get_metrics() {
+  return _metrics;
+}
+
+void TaskGraph::print_metrics() {
+  std::streamsize precision = std::clog.precision();
+  std::clog << "Tasks:\n";
+  for (auto& m : _metrics) {
+    std::clog << "\t" << std::left << std::setw(10) << m.first << std::right
+      << std::setw(6) << m.second.count << " tasks, "
+      << std::fixed << std::setprecision(1) << m.second.seconds << " s (longest "
+      << m.second.maxseconds << " s), waited " << m.second.waitseconds << " s\n";
+  }
+  std::clog.precision(precision);
+}
@@ -0,0 +1,70 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef taskgraph_h
+#define taskgraph_h
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+//-- what the tasks of one type took, filled by TaskGraph::run()
+typedef struct TaskMetrics {
+  std::size_t count = 0;
+  double      seconds = 0.0;     //-- total running time
+  double      maxseconds = 0.0;  //-- longest task
+  double      waitseconds = 0.0; //-- total time ready but waiting for a free worker
+} TaskMetrics;
+
+//-- tasks with dependencies: a task starts once all the tasks it depends on are done, on one
+//-- of the workers. Among the ready tasks the oldest one (first added) starts first, so add
+//-- them in the order they should preferably run. A task returns false if it failed: the
+//-- tasks not started yet are then skipped.
+class TaskGraph {
+public:
+  typedef std::size_t TaskId;
+
+  TaskId add_task(std::string type, std::function<bool()> job, const std::vector<TaskId>& dependencies = std::vector<TaskId>());
+  bool   run(int nthreads = 0);
+  std::map<std::string, TaskMetrics> get_metrics();
+  void   print_metrics();
+private:
+  typedef struct Task {
+    std::string           type;
+    std::function<bool()> job;
+    std::vector<TaskId>   dependents;
+    std::size_t           remaining = 0; //-- dependencies not done yet
+  } Task;
+
+  std::vector<Task>                  _tasks;
+  std::map<std::string, TaskMetrics> _metrics;
+};
+
+#endif /* taskgraph_h */
@@ -0,0 +1,110 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+//-- Map3d::batch_independent_features(): processing the batches one after the other (each
+//-- in any order, as the threads do) gives the same result as the serial loop over the
+//-- features, when each feature modifies itself and its adjacent features (like fix_bowtie)
+
+#include "../Map3d.h"
+#include "../Building.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+    failures++; \
+  }
+
+typedef std::map< TopoFeature*, std::vector<std::string> > History;
+
+//-- the features modified by f, and by which feature in which order
+static void process(TopoFeature* f, History& history) {
+  history[f].push_back(f->get_id());
+  for (auto& adj : *(f->get_adjacent_features()))
+    history[adj].push_back(f->get_id());
+}
+
+static void check_batches(int nfeatures, int nadjacencies, unsigned seed) {
+  std::vector<TopoFeature*> features;
+  for (int i = 0; i < nfeatures; i++) {
+    Polygon2* p2 = new Polygon2();
+    bg::read_wkt("POLYGON((0 0,0 1,1 1,1 0))", *p2);
+    features.push_back(new Building(p2, "layer", NULL, 0, std::to_string(i), 0.9f, 0.1f));
+  }
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dis(0, nfeatures - 1);
+  for (int i = 0; i < nadjacencies; i++) {
+    int a = dis(gen);
+    int b = dis(gen);
+    std::vector<TopoFeature*>* adjs = features[a]->get_adjacent_features();
+    if (a == b || std::find(adjs->begin(), adjs->end(), features[b]) != adjs->end())
+      continue;
+    features[a]->add_adjacent_feature(features[b]);
+    features[b]->add_adjacent_feature(features[a]);
+  }
+
+  History serial;
+  for (auto& f : features)
+    process(f, serial);
+
+  History batched;
+  std::size_t count = 0;
+  for (auto& batch : Map3d::batch_independent_features(features)) {
+    //-- no two features of a batch modify the same feature
+    History inbatch;
+    for (auto& f : batch)
+      process(f, inbatch);
+    for (auto& h : inbatch)
+      CHECK(h.second.size() == 1);
+    //-- in reverse, a batch processed out of order still gives the serial result
+    for (auto it = batch.rbegin(); it != batch.rend(); ++it)
+      process(*it, batched);
+    count += batch.size();
+  }
+  CHECK(count == features.size());
+  CHECK(batched == serial);
+
+  for (auto& f : features)
+    delete f;
+}
+
+int main() {
+  check_batches(10, 0, 1);
+  check_batches(50, 40, 2);
+  check_batches(200, 400, 3);
+  check_batches(200, 2000, 4);
+  if (failures > 0)
+    return 1;
+  std::clog << "test_batches: all checks passed\n";
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+//-- getCDT() of a polygon with a hole and interior points: the constraints of the rings are
+//-- inserted between the vertices, the points after them
+
+#include "../geomtools.h"
+#include <cmath>
+#include <iostream>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+    failures++; \
+  }
+
+static double area_of_triangles(const std::vector< std::pair<Point3, std::string> >& vertices, const std::vector<Triangle>& triangles) {
+  double area = 0.0;
+  for (auto& t : triangles) {
+    const Point3& a = vertices[t.v0].first;
+    const Point3& b = vertices[t.v1].first;
+    const Point3& c = vertices[t.v2].first;
+    area += std::abs((bg::get<0>(b) - bg::get<0>(a)) * (bg::get<1>(c) - bg::get<1>(a)) -
+                     (bg::get<0>(c) - bg::get<0>(a)) * (bg::get<1>(b) - bg::get<1>(a))) / 2.0;
+  }
+  return area;
+}
+
+static void check_cdt(double tinsimp_threshold) {
+  //-- 10x10 square with a 2x2 hole in its middle (outer ring cw, inner ring ccw)
+  Polygon2 pgn;
+  bg::read_wkt("POLYGON((0 0,0 10,10 10,10 0),(4 4,6 4,6 6,4 6))", pgn);
+  std::vector< std::vector<int> > z(2, std::vector<int>(4, 100));
+  std::vector<Point3> lidarpts;
+  for (int i = 1; i < 10; i++) {
+    for (int j = 1; j < 10; j++) {
+      if (i >= 4 && i <= 6 && j >= 4 && j <= 6)
+        continue;
+      lidarpts.push_back(Point3(i + 0.5, j + 0.25, (i + j) % 3 == 0 ? 3.0 : 1.0));
+    }
+  }
+  std::vector< std::pair<Point3, std::string> > vertices;
+  std::vector<Triangle> triangles;
+  CHECK(getCDT(&pgn, z, vertices, triangles, lidarpts, tinsimp_threshold) == true);
+  CHECK(triangles.empty() == false);
+  if (tinsimp_threshold <= 0.0)
+    CHECK(vertices.size() == 8 + lidarpts.size());
+  for (auto& t : triangles) {
+    CHECK(t.v0 >= 0 && t.v0 < int(vertices.size()));
+    CHECK(t.v1 >= 0 && t.v1 < int(vertices.size()));
+    CHECK(t.v2 >= 0 && t.v2 < int(vertices.size()));
+  }
+  if (failures == 0)
+    CHECK(std::abs(area_of_triangles(vertices, triangles) - 96.0) < 1e-6); //-- the hole is not triangulated
+}
+
+int main() {
+  set_cdt_validation(true);
+  check_cdt(0.0);
+  check_cdt(0.5);
+  if (failures > 0)
+    return 1;
+  std::clog << "test_getcdt: all checks passed\n";
+  return 0;
+}
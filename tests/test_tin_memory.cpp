@@ -0,0 +1,80 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+
+  Copyright (C) 2015-2016  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+//-- the point budget of the TIN features (max_points): a small feature with a large budget
+//-- costs no more than without a budget, and a feature never keeps more points than its budget
+
+#include "../Terrain.h"
+#include <iostream>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+    failures++; \
+  }
+
+//-- a 100x100 terrain polygon with n ground points on a grid inside it
+static Terrain* create_terrain(unsigned long max_points, int n) {
+  Polygon2* p2 = new Polygon2();
+  bg::read_wkt("POLYGON((0 0,0 100,100 100,100 0))", *p2);
+  Terrain* t = new Terrain(p2, "layer", NULL, 0, "terrain", 0, 0.0f, 0.0, max_points);
+  int side = 1;
+  while (side * side < n)
+    side++;
+  for (int i = 0; i < n; i++) {
+    Point2 p(1.0 + (i % side) * 98.0 / side, 1.0 + (i / side) * 98.0 / side);
+    t->add_elevation_point(p, 1.0, 1.0f, LAS_GROUND, true);
+  }
+  return t;
+}
+
+int main() {
+  //-- a few points with the documented budget of 1000000: no reservoirs
+  Terrain* unbounded = create_terrain(0, 10);
+  Terrain* bounded = create_terrain(1000000, 10);
+  CHECK(bounded->get_memory_usage() == unbounded->get_memory_usage());
+  CHECK(bounded->get_number_cdt_points() == unbounded->get_number_cdt_points());
+  delete unbounded;
+  delete bounded;
+
+  //-- more points than the budget: at most the budget is kept, the memory is bounded
+  unsigned long budget = 1000;
+  Terrain* sampled = create_terrain(budget, 20000);
+  CHECK(sampled->get_number_cdt_points() <= 4 + budget);
+  Terrain* all = create_terrain(0, 20000);
+  CHECK(sampled->get_memory_usage() < all->get_memory_usage());
+  delete sampled;
+  delete all;
+
+  if (failures > 0)
+    return 1;
+  std::clog << "test_tin_memory: all checks passed\n";
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+  
+  Copyright (C) 2015-2017  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux 
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#include "threadpool.h"
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <exception>
+
+int get_number_of_threads(int requested) {
+  if (requested > 0)
+    return requested;
+  int n = int(std::thread::hardware_concurrency());
+  return (n > 0) ? n : 1;
+}
+
+void parallel_for(std::size_t n, const std::function<void(std::size_t)>& job, int nthreads) {
+  nthreads = get_number_of_threads(nthreads);
+  if (nthreads > int(n))
+    nthreads = int(n);
+  if (nthreads <= 1) {
+    for (std::size_t i = 0; i < n; i++)
+      job(i);
+    return;
+  }
+  std::atomic<std::size_t> next(0);
+  std::exception_ptr error = nullptr;
+  std::atomic<bool> failed(false);
+  auto worker = [&]() {
+    std::size_t i;
+    while (failed == false && (i = next++) < n) {
+      try {
+        job(i);
+      }
+      catch (...) {
+        //-- keep the first exception, it is rethrown in the calling thread
+        if (failed.exchange(true) == false)
+          error = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < nthreads; t++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+}
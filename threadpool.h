@@ -0,0 +1,43 @@
+/*
+  3dfier: takes 2D GIS datasets and "3dfies" to create 3D city models.
+  
+  Copyright (C) 2015-2017  3D geoinformation research group, TU Delft
+
+  This file is part of 3dfier.
+
+  3dfier is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  3dfier is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with 3difer.  If not, see <http://www.gnu.org/licenses/>.
+
+  For any information or further details about the use of 3dfier, contact
+  Hugo Ledoux 
+  <h.ledoux@tudelft.nl>
+  Faculty of Architecture & the Built Environment
+  Delft University of Technology
+  Julianalaan 134, Delft 2628BL, the Netherlands
+*/
+
+#ifndef threadpool_h
+#define threadpool_h
+
+#include <functional>
+#include <cstddef>
+
+//-- number of worker threads to use when 0 (automatic) is asked
+int  get_number_of_threads(int requested);
+
+//-- runs job(i) for every i in [0, n) with nthreads workers. The workers all pull the
+//-- next index from a shared counter, so jobs are started in order: put the most
+//-- expensive jobs first and no worker ends up alone with a big one at the end.
+void parallel_for(std::size_t n, const std::function<void(std::size_t)>& job, int nthreads = 0);
+
+#endif /* threadpool_h */